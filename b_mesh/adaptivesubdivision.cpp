@@ -0,0 +1,149 @@
+#include "adaptivesubdivision.h"
+#include "catmullclark.h"
+#include "curvature.h"
+#include "profiler.h"
+#include <math.h>
+
+AdaptiveSubdivision::AdaptiveSubdivision() : maxBend(0.5f), maxScreenSize(0), pixelsPerUnit(0)
+{
+}
+
+void AdaptiveSubdivision::setView(const Vector3 &eye, float fieldOfViewDegrees, int viewportHeight)
+{
+    this->eye = eye;
+    pixelsPerUnit = viewportHeight / (2 * tanf(fieldOfViewDegrees * M_PI / 360));
+}
+
+// the corners of face f, which counts the triangles first and then the quads
+static int faceCorners(const Mesh &mesh, int f, int *corners)
+{
+    int numTriangles = mesh.triangles.count();
+    if (f < numTriangles)
+    {
+        const Triangle &tri = mesh.triangles[f];
+        corners[0] = tri.a.index;
+        corners[1] = tri.b.index;
+        corners[2] = tri.c.index;
+        return 3;
+    }
+    const Quad &quad = mesh.quads[f - numTriangles];
+    corners[0] = quad.a.index;
+    corners[1] = quad.b.index;
+    corners[2] = quad.c.index;
+    corners[3] = quad.d.index;
+    return 4;
+}
+
+// Curvature leaves the vertices it can't fit at zero, which includes any
+// vertex only used by faces it doesn't handle. Those get the largest angle
+// between their normal and the normal of a face around them, divided by the
+// distance to that face's center, instead. Flat spots stay at zero.
+static void estimateMissingBend(const Mesh &mesh, QVector<float> &bend)
+{
+    QVector<bool> missing(bend.count());
+    bool anyMissing = false;
+    for (int i = 0; i < bend.count(); i++)
+    {
+        missing[i] = bend[i] == 0;
+        if (missing[i]) anyMissing = true;
+    }
+    if (!anyMissing) return;
+
+    int numFaces = mesh.triangles.count() + mesh.quads.count();
+    QVector<Vector3> faceNormals(numFaces);
+    QVector<Vector3> normals(bend.count());
+    for (int f = 0; f < numFaces; f++)
+    {
+        int corners[4];
+        int numCorners = faceCorners(mesh, f, corners);
+        const Vector3 &a = mesh.vertices[corners[0]].pos;
+        const Vector3 &b = mesh.vertices[corners[1]].pos;
+        const Vector3 &c = mesh.vertices[corners[2]].pos;
+        const Vector3 &d = mesh.vertices[corners[numCorners - 1]].pos;
+        faceNormals[f] = (numCorners == 3 ? (b - a).cross(c - a) : (c - a).cross(d - b)).unit();
+        for (int i = 0; i < numCorners; i++)
+            if (missing[corners[i]]) normals[corners[i]] += faceNormals[f];
+    }
+    for (int i = 0; i < normals.count(); i++)
+        if (missing[i]) normals[i].normalize();
+
+    for (int f = 0; f < numFaces; f++)
+    {
+        int corners[4];
+        int numCorners = faceCorners(mesh, f, corners);
+        Vector3 center;
+        for (int i = 0; i < numCorners; i++)
+            center += mesh.vertices[corners[i]].pos / numCorners;
+        for (int i = 0; i < numCorners; i++)
+        {
+            int v = corners[i];
+            if (!missing[v]) continue;
+            float distance = (center - mesh.vertices[v].pos).length();
+            float angle = 2 * asinf(qMin((faceNormals[f] - normals[v]).length() / 2, 1.0f));
+            if (distance > 0) bend[v] = qMax(bend[v], angle / distance);
+        }
+    }
+}
+
+int AdaptiveSubdivision::markFaces(const Mesh &mesh, QVector<bool> &refine) const
+{
+    // the largest principal curvature magnitude at each vertex
+    QVector<float> bend;
+    if (maxBend > 0)
+    {
+        Curvature curvature;
+        curvature.computeCurvatures(mesh);
+        const QVector<float> &minCurvatures = curvature.getMinCurvatures();
+        const QVector<float> &maxCurvatures = curvature.getMaxCurvatures();
+        bend.resize(mesh.vertices.count());
+        for (int i = 0; i < bend.count(); i++)
+            bend[i] = qMax(fabsf(minCurvatures[i]), fabsf(maxCurvatures[i]));
+        estimateMissingBend(mesh, bend);
+    }
+
+    refine.fill(false, mesh.triangles.count() + mesh.quads.count());
+    int count = 0;
+
+    for (int f = 0; f < refine.count(); f++)
+    {
+        int corners[4];
+        int numCorners = faceCorners(mesh, f, corners);
+
+        float size = 0, curvature = 0;
+        Vector3 center;
+        for (int i = 0; i < numCorners; i++)
+        {
+            const Vector3 &pos = mesh.vertices[corners[i]].pos;
+            size = qMax(size, (mesh.vertices[corners[(i + 1) % numCorners]].pos - pos).length());
+            center += pos / numCorners;
+            if (!bend.isEmpty()) curvature = qMax(curvature, bend[corners[i]]);
+        }
+
+        // written so a NaN curvature (from a degenerate vertex) doesn't split anything
+        bool split = maxBend > 0 && curvature * size > maxBend;
+        if (maxScreenSize > 0 && pixelsPerUnit > 0)
+            split = split || size * pixelsPerUnit > maxScreenSize * (center - eye).length();
+        if (split)
+        {
+            refine[f] = true;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+bool AdaptiveSubdivision::run(Mesh &mesh, int levels) const
+{
+    PROFILE_SCOPE("AdaptiveSubdivision::run");
+    QVector<bool> refine;
+    for (int level = 0; level < levels; level++)
+    {
+        if (!markFaces(mesh, refine))
+            break;
+        if (!CatmullMesh::subdivide(mesh, mesh, refine))
+            return false;
+    }
+    PROFILE_COUNTER("adaptive vertices", mesh.vertices.count());
+    return true;
+}
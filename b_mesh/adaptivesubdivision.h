@@ -0,0 +1,40 @@
+#ifndef ADAPTIVESUBDIVISION_H
+#define ADAPTIVESUBDIVISION_H
+
+#include "mesh.h"
+
+/**
+ * Catmull-Clark subdivision that only refines where it shows. Each step
+ * splits the faces that bend too much (the largest principal curvature at a
+ * corner times the longest edge of the face, roughly the angle in radians the
+ * surface turns across it) or that cover too many pixels, and leaves flat or
+ * small faces alone. Transitions between levels are fanned into triangles,
+ * see CatmullMesh::subdivide(in, out, refine), so the result is crack-free:
+ *
+ *     AdaptiveSubdivision adaptive;
+ *     adaptive.maxBend = 0.5f;
+ *     adaptive.setView(camera.eye, 45, height()); // optional
+ *     adaptive.run(mesh, 3);
+ */
+class AdaptiveSubdivision
+{
+public:
+    float maxBend; // 0 ignores curvature
+    float maxScreenSize; // in pixels, 0 ignores the view
+    Vector3 eye;
+    float pixelsPerUnit; // pixels covered by a length of one at distance one from the eye
+
+    AdaptiveSubdivision();
+
+    // sets eye and pixelsPerUnit for a perspective projection
+    void setView(const Vector3 &eye, float fieldOfViewDegrees, int viewportHeight);
+
+    // fills in refine for CatmullMesh::subdivide() and returns the number of faces to split
+    int markFaces(const Mesh &mesh, QVector<bool> &refine) const;
+
+    // up to the given number of steps, stops early once no face needs splitting,
+    // returns false if the mesh can't be subdivided
+    bool run(Mesh &mesh, int levels) const;
+};
+
+#endif // ADAPTIVESUBDIVISION_H
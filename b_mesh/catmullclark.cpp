@@ -1,4 +1,6 @@
 #include "catmullclark.h"
+#include "profiler.h"
+#include "parallel.h"
 #include <QHashIterator>
 
 void addJointWeights(const QHash<int, float> &src, QHash<int, float> &dst, float weight) {
@@ -10,231 +12,561 @@ void addJointWeights(const QHash<int, float> &src, QHash<int, float> &dst, float
 }
 
 
-QPair<int, int> getEdgeIndex(int v1, int v2) {
-    return v1 < v2 ? QPair<int, int>(v1, v2) : QPair<int, int>(v2, v1);
+CatmullMesh::CatmullMesh(const Mesh &m) : original(m.vertices), hasWeights(false), valid(false) {
+    foreach (const Vertex &v, m.vertices) {
+        if (!v.jointWeights.isEmpty()) {
+            hasWeights = true;
+            break;
+        }
+    }
+
+    // lay the faces out as runs of corners, triangles first
+    int numFaces = m.triangles.size() + m.quads.size();
+    int numCorners = m.triangles.size() * 3 + m.quads.size() * 4;
+    faceStart.resize(numFaces + 1);
+    cornerPoint.resize(numCorners);
+    cornerFace.resize(numCorners);
+    cornerEdge.resize(numCorners);
+
+    int *start = faceStart.data();
+    int *point = cornerPoint.data();
+    int *face = cornerFace.data();
+    int f = 0, c = 0;
+    foreach (const Triangle &tri, m.triangles) {
+        start[f] = c;
+        point[c] = tri.a.index;
+        point[c + 1] = tri.b.index;
+        point[c + 2] = tri.c.index;
+        face[c] = face[c + 1] = face[c + 2] = f++;
+        c += 3;
+    }
+    foreach (const Quad &quad, m.quads) {
+        start[f] = c;
+        point[c] = quad.a.index;
+        point[c + 1] = quad.b.index;
+        point[c + 2] = quad.c.index;
+        point[c + 3] = quad.d.index;
+        face[c] = face[c + 1] = face[c + 2] = face[c + 3] = f++;
+        c += 4;
+    }
+    start[numFaces] = numCorners;
+
+    if (!buildEdges()) return;
+    buildVertexAdjacency();
+
+    // the new vertices are laid out in the order they appear in the output mesh
+    edgeOffset = original.size();
+    faceOffset = edgeOffset + edges.size();
+    points.resize(faceOffset + numFaces);
+
+    // edge points use the face points
+    parallelFor(numFaces, this, &CatmullMesh::computeFacePoints);
+    parallelFor(edges.size(), this, &CatmullMesh::computeEdgePoints);
+    valid = true;
 }
 
+// build the edge table and fill in cornerEdge, edges end up sorted by their
+// vertex indices and each edge's first face is the first one to use it
+bool CatmullMesh::buildEdges() {
+    int numVertices = original.size();
+    int numCorners = cornerPoint.size();
+    const int *start = faceStart.constData();
+    const int *point = cornerPoint.constData();
+    const int *face = cornerFace.constData();
+
+    // bucket the corners by the lower vertex of their outgoing edge, each
+    // bucket keeps its corners in face order
+    QVector<int> lower(numCorners), higher(numCorners);
+    bucketStart.fill(0, numVertices + 1);
+    for (int c = 0; c < numCorners; ++c) {
+        int next = (c + 1 == start[face[c] + 1]) ? start[face[c]] : c + 1;
+        lower[c] = qMin(point[c], point[next]);
+        higher[c] = qMax(point[c], point[next]);
+        ++bucketStart[lower[c] + 1];
+    }
+    for (int v = 0; v < numVertices; ++v) {
+        bucketStart[v + 1] += bucketStart[v];
+    }
+
+    QVector<int> fill(bucketStart);
+    bucketKeys.resize(numCorners);
+    bucketCorners.resize(numCorners);
+    for (int c = 0; c < numCorners; ++c) {
+        int slot = fill[lower[c]]++;
+        bucketKeys[slot] = higher[c];
+        bucketCorners[slot] = c;
+    }
 
-CatmullFace::CatmullFace(int numSides) : n(numSides) {
-    for (int i = 0; i < numSides; ++i) {
-        neighbors += NULL;
-        points += -1;
-        edges += QPair<int, int>();
+    // count the edges in each bucket, then give each bucket its range of edges
+    bucketEdgeStart.resize(numVertices + 1);
+    parallelFor(numVertices, this, &CatmullMesh::sortEdgeBuckets);
+    int numEdges = 0;
+    for (int v = 0; v < numVertices; ++v) {
+        int count = bucketEdgeStart[v];
+        if (count < 0) {
+            std::cerr << "Error, edge connects to more than 2 faces" << std::endl;
+            return false;
+        }
+        bucketEdgeStart[v] = numEdges;
+        numEdges += count;
     }
+    bucketEdgeStart[numVertices] = numEdges;
+
+    edges.resize(numEdges);
+    parallelFor(numVertices, this, &CatmullMesh::emitEdges);
+
+    bucketStart.clear();
+    bucketKeys.clear();
+    bucketCorners.clear();
+    bucketEdgeStart.clear();
+    return true;
 }
 
+// buckets only hold a few corners, a stable insertion sort by the higher
+// vertex puts each edge's corners next to each other without reordering them
+void CatmullMesh::sortEdgeBuckets(int begin, int end) {
+    const int *bucket = bucketStart.constData();
+    int *keys = bucketKeys.data();
+    int *corners = bucketCorners.data();
+    int *edgeCount = bucketEdgeStart.data();
+
+    for (int v = begin; v < end; ++v) {
+        int first = bucket[v], last = bucket[v + 1];
+        for (int i = first + 1; i < last; ++i) {
+            int key = keys[i], corner = corners[i], j = i;
+            for (; j > first && keys[j - 1] > key; --j) {
+                keys[j] = keys[j - 1];
+                corners[j] = corners[j - 1];
+            }
+            keys[j] = key;
+            corners[j] = corner;
+        }
 
-CatmullMesh::CatmullMesh(const Mesh &m) {
-    // copy the vertices over
-    foreach (const Vertex &v, m.vertices) {
-        CatmullVertex cv;
-        cv.pos = v.pos;
-        cv.jointWeights = v.jointWeights;
-        vertices += cv;
+        // each run of equal keys is one edge, more than two faces is an error
+        int count = 0;
+        for (int i = first, j; i < last; i = j) {
+            for (j = i + 1; j < last && keys[j] == keys[i]; ++j);
+            if (j - i > 2) {
+                count = -1;
+                break;
+            }
+            ++count;
+        }
+        edgeCount[v] = count;
+    }
+}
+
+void CatmullMesh::emitEdges(int begin, int end) {
+    const int *bucket = bucketStart.constData();
+    const int *firstEdge = bucketEdgeStart.constData();
+    const int *keys = bucketKeys.constData();
+    const int *corners = bucketCorners.constData();
+    const int *face = cornerFace.constData();
+    int *cornerToEdge = cornerEdge.data();
+    CatmullEdge *edgeList = edges.data();
+
+    for (int v = begin; v < end; ++v) {
+        int e = firstEdge[v], last = bucket[v + 1];
+        for (int i = bucket[v], j; i < last; i = j, ++e) {
+            for (j = i + 1; j < last && keys[j] == keys[i]; ++j);
+            CatmullEdge &edge = edgeList[e];
+            edge.points[0] = v;
+            edge.points[1] = keys[i];
+            edge.faces[0] = face[corners[i]];
+            edge.faces[1] = (j - i == 2) ? face[corners[i + 1]] : -1;
+            for (int k = i; k < j; ++k) {
+                cornerToEdge[corners[k]] = e;
+            }
+        }
     }
+}
 
-    // create the faces with vertices only
-    foreach (const Triangle &tri, m.triangles) {
-        CatmullFace cTri(3);
-        // set vertices (copies made since Catmull vertex positions will be changed)
-        cTri.points[0] = tri.a.index;
-        cTri.points[1] = tri.b.index;
-        cTri.points[2] = tri.c.index;
-        faces += cTri;
+// find the corners and edges around each vertex, in the order the faces use them
+void CatmullMesh::buildVertexAdjacency() {
+    int numVertices = original.size();
+    int numCorners = cornerPoint.size();
+    const int *point = cornerPoint.constData();
+
+    vertexStart.fill(0, numVertices + 1);
+    for (int c = 0; c < numCorners; ++c) {
+        ++vertexStart[point[c] + 1];
+    }
+    for (int v = 0; v < numVertices; ++v) {
+        vertexStart[v + 1] += vertexStart[v];
     }
 
-    foreach (const Quad &quad, m.quads) {
-        CatmullFace cQuad(4);
-        cQuad.points[0] = quad.a.index;
-        cQuad.points[1] = quad.b.index;
-        cQuad.points[2] = quad.c.index;
-        cQuad.points[3] = quad.d.index;
-        faces += cQuad;
-    }
-
-    // add the edges and face points
-    for (int iface = 0; iface < faces.size(); ++iface) {
-        CatmullFace &face = faces[iface];
-
-        // add edges
-        for (int i = 0; i < face.n; ++i) {
-            const QPair<int, int>& pair = getEdgeIndex(face.points[i], face.points[(i + 1) % face.n]);
-            face.edges[i] = pair;
-            if (!edges.contains(pair)) {
-                edges[pair].faces[0] = &face;
-            } else if (edges[pair].faces[1] == NULL) {
-                edges[pair].faces[1] = &face;
-            } else {
-                std::cerr << "Error, edge connects to more than 2 faces" << std::endl;
-                valid = false;
-                return;
+    QVector<int> fill(vertexStart);
+    vertexCorners.resize(numCorners);
+    for (int c = 0; c < numCorners; ++c) {
+        vertexCorners[fill[point[c]]++] = c;
+    }
+
+    vertexEdges.resize(numCorners * 2);
+    vertexEdgeCount.resize(numVertices);
+    parallelFor(numVertices, this, &CatmullMesh::gatherVertexEdges);
+}
+
+// every corner brings its outgoing and incoming edge, which are shared with
+// the neighboring corners around the vertex, so keep the first of each
+void CatmullMesh::gatherVertexEdges(int begin, int end) {
+    const int *start = faceStart.constData();
+    const int *face = cornerFace.constData();
+    const int *cornerToEdge = cornerEdge.constData();
+    const int *first = vertexStart.constData();
+    const int *corners = vertexCorners.constData();
+    int *edgeSlots = vertexEdges.data();
+    int *edgeCount = vertexEdgeCount.data();
+
+    for (int v = begin; v < end; ++v) {
+        int *vertexSlots = edgeSlots + first[v] * 2;
+        int count = 0;
+        for (int i = first[v]; i < first[v + 1]; ++i) {
+            int c = corners[i];
+            int prev = (c == start[face[c]]) ? start[face[c] + 1] - 1 : c - 1;
+            int candidates[2] = { cornerToEdge[c], cornerToEdge[prev] };
+            for (int k = 0; k < 2; ++k) {
+                int j = 0;
+                while (j < count && vertexSlots[j] != candidates[k]) ++j;
+                if (j == count) vertexSlots[count++] = candidates[k];
             }
         }
+        edgeCount[v] = count;
+    }
+}
 
-        // add face point
-        Vertex fp;
-        fp.pos = Vector3();
-        // set face point to average of vertex points
-        float weight = 1.f / face.n;
-        for (int i = 0; i < face.n; ++i) {
-            fp.pos += vertices[face.points[i]].pos;
-            addJointWeights(vertices[face.points[i]].jointWeights, fp.jointWeights, weight);
+// each face point is the average of the face's vertices
+void CatmullMesh::computeFacePoints(int begin, int end) {
+    const int *start = faceStart.constData();
+    const int *point = cornerPoint.constData();
+    const Vertex *in = original.constData();
+    Vertex *out = points.data() + faceOffset;
+
+    for (int f = begin; f < end; ++f) {
+        Vertex &fp = out[f];
+        float weight = 1.f / (start[f + 1] - start[f]);
+        for (int c = start[f]; c < start[f + 1]; ++c) {
+            fp.pos += in[point[c]].pos;
         }
         fp.pos *= weight;
 
-        face.facePoint = facePoints.size();
-        facePoints += fp;
+        if (hasWeights) {
+            for (int c = start[f]; c < start[f + 1]; ++c) {
+                addJointWeights(in[point[c]].jointWeights, fp.jointWeights, weight);
+            }
+        }
     }
+}
+
+void CatmullMesh::computeEdgePoints(int begin, int end) {
+    const Vertex *in = original.constData();
+    const CatmullEdge *edgeList = edges.constData();
+    const Vertex *facePoints = points.constData() + faceOffset;
+    Vertex *out = points.data() + edgeOffset;
 
-    // add the edge points
-    QMap<QPair<int, int>, CatmullEdge>::const_iterator it;
-    for (it = edges.begin(); it != edges.end(); ++it) {
-        CatmullEdge &edge = edges[it.key()];
+    for (int e = begin; e < end; ++e) {
+        const CatmullEdge &edge = edgeList[e];
+        const Vertex &v1 = in[edge.points[0]];
+        const Vertex &v2 = in[edge.points[1]];
+        Vertex &ep = out[e];
 
-        if (it.value().faces[1] == NULL) {
+        if (edge.faces[1] == -1) {
             // for edges on the border of a hole, the edge point is average of edge endpoints
-            edge.pos = (vertices[it.key().first].pos + vertices[it.key().second].pos) / 2;
+            ep.pos = (v1.pos + v2.pos) / 2;
 
             // set the weights for animation
-            addJointWeights(vertices[it.key().first].jointWeights, edge.jointWeights, 0.5f);
-            addJointWeights(vertices[it.key().second].jointWeights, edge.jointWeights, 0.5f);
+            if (hasWeights) {
+                addJointWeights(v1.jointWeights, ep.jointWeights, 0.5f);
+                addJointWeights(v2.jointWeights, ep.jointWeights, 0.5f);
+            }
         } else {
             // edge point is average of edge endpoints and adjacent face points
-            edge.pos = (vertices[it.key().first].pos + vertices[it.key().second].pos +
-                               facePoints[it.value().faces[0]->facePoint].pos + facePoints[it.value().faces[1]->facePoint].pos) / 4;
+            const Vertex &f1 = facePoints[edge.faces[0]];
+            const Vertex &f2 = facePoints[edge.faces[1]];
+            ep.pos = (v1.pos + v2.pos + f1.pos + f2.pos) / 4;
 
             // set the weights for animation
-            addJointWeights(vertices[it.key().first].jointWeights, edge.jointWeights, 0.25f);
-            addJointWeights(vertices[it.key().second].jointWeights, edge.jointWeights, 0.25f);
-            addJointWeights(facePoints[it.value().faces[0]->facePoint].jointWeights, edge.jointWeights, 0.25f);
-            addJointWeights(facePoints[it.value().faces[1]->facePoint].jointWeights, edge.jointWeights, 0.25f);
+            if (hasWeights) {
+                addJointWeights(v1.jointWeights, ep.jointWeights, 0.25f);
+                addJointWeights(v2.jointWeights, ep.jointWeights, 0.25f);
+                addJointWeights(f1.jointWeights, ep.jointWeights, 0.25f);
+                addJointWeights(f2.jointWeights, ep.jointWeights, 0.25f);
+            }
         }
     }
-
-    valid = true;
 }
 
 // update the mesh vertices (step 3 of Catmull-Clark subdivision)
-bool CatmullMesh::moveVertices() {
-    // find neighboring edges and faces
-    foreach (const CatmullFace &face, faces) {
-        for (int i = 0; i < face.n; ++i) {
-            int prevIndex = (i == 0 ? face.n - 1 : i - 1);
-            CatmullVertex &v = vertices[face.points[i]];
-            v.facePoints += &facePoints[face.facePoint];
-            if (!v.edges.contains(&edges[face.edges[i]])) {
-                v.edges += &edges[face.edges[i]];
-            }
-            if (!v.edges.contains(&edges[face.edges[prevIndex]])) {
-                v.edges += &edges[face.edges[prevIndex]];
-            }
-        }
-    }
-
-    // take averages for faces and edges and move vertices
-    Vector3 faceAverage, edgeAverage;
-    for (int i = 0; i < vertices.size(); ++i) {
-        CatmullVertex &v = vertices[i];
-        QHash<int, float> origWeights = v.jointWeights;
-        v.jointWeights.clear();
-
-        faceAverage.x = faceAverage.y = faceAverage.z = 0;
-        edgeAverage.x = edgeAverage.y = edgeAverage.z = 0;
-
-        if (v.edges.size() != v.facePoints.size()) {
+void CatmullMesh::moveVertices(int begin, int end) {
+    const Vertex *in = original.constData();
+    const CatmullEdge *edgeList = edges.constData();
+    const int *face = cornerFace.constData();
+    const int *first = vertexStart.constData();
+    const int *edgeCount = vertexEdgeCount.constData();
+    Vertex *out = points.data();
+    const Vertex *edgePoints = out + edgeOffset;
+    const Vertex *facePoints = out + faceOffset;
+
+    for (int v = begin; v < end; ++v) {
+        const Vertex &orig = in[v];
+        Vertex &result = out[v];
+        const int *corners = vertexCorners.constData() + first[v];
+        const int *vertexEdgeList = vertexEdges.constData() + first[v] * 2;
+        int numFaces = first[v + 1] - first[v];
+        int numEdges = edgeCount[v];
+        Vector3 faceAverage, edgeAverage;
+
+        if (numEdges != numFaces) {
             // point is on the border of a hole, average edges along hole and old point
             int count = 0;
-            foreach (const CatmullEdge *edge, v.edges) {
-                if (edge->faces[1] == NULL) {
-                    edgeAverage += edge->pos;
+            for (int i = 0; i < numEdges; ++i) {
+                if (edgeList[vertexEdgeList[i]].faces[1] == -1) {
+                    edgeAverage += edgePoints[vertexEdgeList[i]].pos;
                     ++count;
                 }
             }
-            v.pos = (edgeAverage + v.pos) / (count + 1);
+            result.pos = (edgeAverage + orig.pos) / (count + 1);
 
             // second pass to add in animation weights
-            float weight = 1.f / (count + 1);
-            foreach (const CatmullEdge *edge, v.edges) {
-                addJointWeights(edge->jointWeights, v.jointWeights, weight);
+            if (hasWeights) {
+                float weight = 1.f / (count + 1);
+                for (int i = 0; i < numEdges; ++i) {
+                    addJointWeights(edgePoints[vertexEdgeList[i]].jointWeights, result.jointWeights, weight);
+                }
+                addJointWeights(orig.jointWeights, result.jointWeights, weight);
             }
-            addJointWeights(origWeights, v.jointWeights, weight);
 
         } else {
-            int numNeighbors = v.edges.size();
+            int numNeighbors = numEdges;
             float weight = 1.f / (numNeighbors * numNeighbors);
             for (int i = 0; i < numNeighbors; ++i) {
-                faceAverage += v.facePoints[i]->pos;
-                edgeAverage += v.edges[i]->pos;
-                addJointWeights(v.facePoints[i]->jointWeights, v.jointWeights, weight);
-                addJointWeights(v.edges[i]->jointWeights, v.jointWeights, 2 * weight);
+                const Vertex &fp = facePoints[face[corners[i]]];
+                const Vertex &ep = edgePoints[vertexEdgeList[i]];
+                faceAverage += fp.pos;
+                edgeAverage += ep.pos;
+                if (hasWeights) {
+                    addJointWeights(fp.jointWeights, result.jointWeights, weight);
+                    addJointWeights(ep.jointWeights, result.jointWeights, 2 * weight);
+                }
             }
             faceAverage /= numNeighbors;
             edgeAverage /= numNeighbors;
 
-            addJointWeights(origWeights, v.jointWeights, (numNeighbors - 3.f) / numNeighbors);
+            if (hasWeights) {
+                addJointWeights(orig.jointWeights, result.jointWeights, (numNeighbors - 3.f) / numNeighbors);
+            }
 
             // Pnew = ( F + 2R + (n - 3)P ) / n
-            v.pos = (faceAverage + edgeAverage * 2 + v.pos * (numNeighbors - 3)) / numNeighbors;
+            result.pos = (faceAverage + edgeAverage * 2 + orig.pos * (numNeighbors - 3)) / numNeighbors;
         }
     }
+}
 
-    return true;
+// each face corner becomes a quad, and the quads of a face are consecutive
+void CatmullMesh::emitQuads(int begin, int end) {
+    const int *start = faceStart.constData();
+    const int *point = cornerPoint.constData();
+    const int *cornerToEdge = cornerEdge.constData();
+    Quad *q = quads.data() + start[begin];
+
+    for (int f = begin; f < end; ++f) {
+        int faceIndex = faceOffset + f;
+        for (int c = start[f]; c < start[f + 1]; ++c, ++q) {
+            int prev = (c == start[f]) ? start[f + 1] - 1 : c - 1;
+            q->a = point[c];
+            q->b = edgeOffset + cornerToEdge[c];
+            q->c = faceIndex;
+            q->d = edgeOffset + cornerToEdge[prev];
+        }
+    }
 }
 
 
 bool CatmullMesh::convertToMesh(Mesh &m) {
-    // clear the old mesh
-    m.vertices.clear();
+    quads.resize(cornerPoint.size());
+    parallelFor(faceStart.size() - 1, this, &CatmullMesh::emitQuads);
+
+    // hand the vertices over instead of sharing them, so updating the normals doesn't copy them
+    qSwap(m.vertices, points);
     m.triangles.clear();
-    m.quads.clear();
+    qSwap(m.quads, quads);
+    return true;
+}
+
+// faces are split or fanned sequentially, the points were already computed in parallel
+void CatmullMesh::convertToAdaptiveMesh(Mesh &m, QVector<bool> refine) {
+    int numFaces = faceStart.size() - 1;
+    QVector<bool> edgeSplit(edges.size(), false);
+    bool changed = true;
+    while (changed) {
+        // an edge is split if a face on either side is split
+        for (int f = 0; f < numFaces; ++f) {
+            if (!refine[f]) continue;
+            for (int c = faceStart[f]; c < faceStart[f + 1]; ++c) edgeSplit[cornerEdge[c]] = true;
+        }
 
-    // create the list of vertices
-    foreach (const CatmullVertex &cv, vertices) {
-        Vertex v;
-        v.pos = cv.pos;
-        v.jointWeights = cv.jointWeights;
-        m.vertices += v;
+        // split faces that would otherwise turn into fans of thin triangles,
+        // repeat since that splits more edges
+        changed = false;
+        for (int f = 0; f < numFaces; ++f) {
+            if (refine[f]) continue;
+            int split = 0;
+            for (int c = faceStart[f]; c < faceStart[f + 1]; ++c) split += edgeSplit[cornerEdge[c]];
+            if (split * 2 > faceStart[f + 1] - faceStart[f]) refine[f] = changed = true;
+        }
     }
 
-    QMap<QPair<int, int>, int> edgeIndices;
-    QMap<QPair<int, int>, CatmullEdge>::const_iterator it;
-    for (it = edges.begin(); it != edges.end(); ++it) {
-        const CatmullEdge &edge = it.value();
-        edgeIndices[it.key()] = m.vertices.size();
-        Vertex v;
-        v.pos = edge.pos;
-        v.jointWeights = edge.jointWeights;
-        m.vertices += v;
+    // keep the layout of subdivide() but leave out the unused points
+    QVector<int> remap(points.size(), -1);
+    int count = 0;
+    for (int v = 0; v < edgeOffset; ++v) remap[v] = count++;
+    for (int e = 0; e < edges.size(); ++e) {
+        if (edgeSplit[e]) remap[edgeOffset + e] = count++;
+    }
+    for (int f = 0; f < numFaces; ++f) {
+        bool used = refine[f];
+        for (int c = faceStart[f]; !used && c < faceStart[f + 1]; ++c) used = edgeSplit[cornerEdge[c]];
+        if (used) remap[faceOffset + f] = count++;
     }
 
-    int faceOffset = m.vertices.size();
-    foreach (const Vertex &cv, facePoints) {
-        m.vertices += cv;
+    QVector<Vertex> vertices(count);
+    for (int i = 0; i < points.size(); ++i) {
+        if (remap[i] != -1) qSwap(vertices[remap[i]], points[i]);
     }
 
-    // create the lists of quads and triangles
-    foreach (const CatmullFace &face, faces) {
-        int faceIndex = faceOffset + face.facePoint;
-        for (int i = 0; i < face.n; ++i) {
-            Quad q;
-            q.a = face.points[i];
-            q.b = edgeIndices[face.edges[i]];
-            q.c = faceIndex;
-            q.d = edgeIndices[face.edges[(i + face.n - 1) % face.n]];
-            m.quads += q;
+    QVector<Triangle> triangles;
+    QVector<Quad> faces;
+    for (int f = 0; f < numFaces; ++f) {
+        int first = faceStart[f], last = faceStart[f + 1];
+        int facePoint = remap[faceOffset + f];
+
+        for (int c = first; c < last; ++c) {
+            int next = (c + 1 == last) ? first : c + 1;
+            int prev = (c == first) ? last - 1 : c - 1;
+            int edgePoint = remap[edgeOffset + cornerEdge[c]];
+
+            if (refine[f]) {
+                // the same quads as emitQuads()
+                faces += Quad(cornerPoint[c], edgePoint, facePoint, remap[edgeOffset + cornerEdge[prev]]);
+            } else if (facePoint != -1) {
+                // fan around the face point through the corners and the split edges
+                if (edgePoint == -1) {
+                    triangles += Triangle(facePoint, cornerPoint[c], cornerPoint[next]);
+                } else {
+                    triangles += Triangle(facePoint, cornerPoint[c], edgePoint);
+                    triangles += Triangle(facePoint, edgePoint, cornerPoint[next]);
+                }
+            }
+        }
+
+        // faces away from the split ones stay as they are
+        if (!refine[f] && facePoint == -1) {
+            const int *point = cornerPoint.constData() + first;
+            if (last - first == 3) triangles += Triangle(point[0], point[1], point[2]);
+            else faces += Quad(point[0], point[1], point[2], point[3]);
         }
     }
 
-    return true;
+    qSwap(m.vertices, vertices);
+    qSwap(m.triangles, triangles);
+    qSwap(m.quads, faces);
+}
+
+
+void CatmullMesh::addFaceStencil(int face, float weight, QVector<int> &indices, QVector<float> &weights) const {
+    int first = faceStart[face], last = faceStart[face + 1];
+    for (int c = first; c < last; ++c) {
+        indices += cornerPoint[c];
+        weights += weight / (last - first);
+    }
+}
+
+void CatmullMesh::addEdgeStencil(int edge, float weight, QVector<int> &indices, QVector<float> &weights) const {
+    const CatmullEdge &e = edges[edge];
+    if (e.faces[1] == -1) {
+        indices << e.points[0] << e.points[1];
+        weights << weight * 0.5f << weight * 0.5f;
+    } else {
+        indices << e.points[0] << e.points[1];
+        weights << weight * 0.25f << weight * 0.25f;
+        addFaceStencil(e.faces[0], weight * 0.25f, indices, weights);
+        addFaceStencil(e.faces[1], weight * 0.25f, indices, weights);
+    }
+}
+
+// the same formulas as moveVertices(), computeEdgePoints() and computeFacePoints()
+// with the edge and face points expanded into the input vertices they average
+void CatmullMesh::getStencils(QVector<int> &offsets, QVector<int> &indices, QVector<float> &weights) const {
+    int numVertices = original.size();
+    int numFaces = faceStart.size() - 1;
+    offsets.clear();
+    indices.clear();
+    weights.clear();
+    offsets.reserve(numVertices + edges.size() + numFaces + 1);
+
+    for (int v = 0; v < numVertices; ++v) {
+        offsets += indices.size();
+        const int *corners = vertexCorners.constData() + vertexStart[v];
+        const int *vertexEdgeList = vertexEdges.constData() + vertexStart[v] * 2;
+        int numFacesAround = vertexStart[v + 1] - vertexStart[v];
+        int numEdges = vertexEdgeCount[v];
+
+        if (numEdges != numFacesAround) {
+            int count = 0;
+            for (int i = 0; i < numEdges; ++i) {
+                if (edges[vertexEdgeList[i]].faces[1] == -1) ++count;
+            }
+            float weight = 1.f / (count + 1);
+            for (int i = 0; i < numEdges; ++i) {
+                if (edges[vertexEdgeList[i]].faces[1] == -1) addEdgeStencil(vertexEdgeList[i], weight, indices, weights);
+            }
+            indices += v;
+            weights += weight;
+        } else {
+            int n = numEdges;
+            float weight = 1.f / (n * n);
+            for (int i = 0; i < n; ++i) {
+                addFaceStencil(cornerFace[corners[i]], weight, indices, weights);
+                addEdgeStencil(vertexEdgeList[i], 2 * weight, indices, weights);
+            }
+            indices += v;
+            weights += (n - 3.f) / n;
+        }
+    }
+
+    for (int e = 0; e < edges.size(); ++e) {
+        offsets += indices.size();
+        addEdgeStencil(e, 1, indices, weights);
+    }
+
+    for (int f = 0; f < numFaces; ++f) {
+        offsets += indices.size();
+        addFaceStencil(f, 1, indices, weights);
+    }
+    offsets += indices.size();
 }
 
 
 bool CatmullMesh::subdivide(const Mesh &in, Mesh &out) {
+    PROFILE_SCOPE("CatmullMesh::subdivide");
     CatmullMesh cm(in);
     if (!cm.valid) return false;
-    if (!cm.moveVertices()) return false;
+    parallelFor(cm.original.size(), &cm, &CatmullMesh::moveVertices);
     out.balls = in.balls;
     if (!cm.convertToMesh(out)) return false;
     out.updateNormals();
+    PROFILE_COUNTER("subdivided quads", out.quads.count());
+    return true;
+}
+
+
+bool CatmullMesh::subdivide(const Mesh &in, Mesh &out, const QVector<bool> &refine) {
+    PROFILE_SCOPE("CatmullMesh::subdivide (adaptive)");
+    CatmullMesh cm(in);
+    if (!cm.valid || refine.size() != cm.faceStart.size() - 1) return false;
+    parallelFor(cm.original.size(), &cm, &CatmullMesh::moveVertices);
+    out.balls = in.balls;
+    cm.convertToAdaptiveMesh(out, refine);
+    out.updateNormals();
+    PROFILE_COUNTER("subdivided quads", out.quads.count());
     return true;
 }
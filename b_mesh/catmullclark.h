@@ -2,8 +2,6 @@
 #define CATMULLCLARK_H
 
 #include <QVector>
-#include <QMap>
-#include <QPair>
 #include <QHash>
 #include "mesh.h"
 
@@ -12,38 +10,16 @@
   To subdivide a mesh, call CatmullMesh::subdivide(inputMesh, outputMesh);
   **/
 
-// a face in a CatmullMesh
-struct CatmullFace {
-    CatmullFace(int numSides);
-
-    int n;
-    // these are filled to the correct size in the constructor, so they can be treated like arrays after construction
-    QVector<const CatmullFace *> neighbors;
-    QVector<int> points; // point indices
-    QVector<QPair<int, int> > edges; // edge indices
-    int facePoint;
-};
-
-// an edge in a CatmullMesh
+// an edge in a CatmullMesh, points[0] < points[1]
 struct CatmullEdge {
-    CatmullEdge() { faces[0] = faces[1] = NULL; }
-
-    Vector3 pos; // position of this edge's edgePoint
-    QHash<int, float> jointWeights; // weighted joints for animation
-    CatmullFace *faces[2];
+    int points[2]; // vertex indices
+    int faces[2]; // faces[1] is -1 for edges on the border of a hole
 };
 
-// a vertex in a CatmullMesh
-struct CatmullVertex {
-    Vector3 pos;
-
-    QHash<int, float> jointWeights; // weighted joints for animation
-    QVector<Vertex *> facePoints; // face points for faces including this vertex
-    QVector<CatmullEdge *> edges; // edges including this vertex
-
-};
-
-// a mesh holding additional data used for Catmull-Clark subdivision
+// a mesh holding additional data used for Catmull-Clark subdivision, everything
+// is kept in flat arrays indexed by vertex, edge, face or face corner. Each step
+// is split over the global QThreadPool (see parallel.h) and every thread only
+// writes to the entries it owns, so the output doesn't depend on the thread count.
 class CatmullMesh {
 public:
     // create the mesh Catmull mesh from a regular mesh
@@ -53,14 +29,72 @@ public:
     static bool subdivide(const Mesh &in, Mesh &out);
     static bool subdivide(Mesh &mesh) { return subdivide(mesh, mesh); }
 
+    // adaptive version of subdivide(), only the faces with refine[face] set are
+    // split (faces are numbered triangles first, then quads). A face left alone
+    // next to a split face is fanned into triangles around its face point so the
+    // result has no T-junctions, and a face with more than half of its edges split
+    // is split as well. Every original vertex moves like in subdivide(), edge and
+    // face points that no face uses are left out.
+    static bool subdivide(const Mesh &in, Mesh &out, const QVector<bool> &refine);
+
+    // false if the input had an edge with more than two faces
+    bool isValid() const { return valid; }
+
+    // the vertices subdivide() would output as weighted sums of the input vertices:
+    // output vertex i is the sum of weights[j] * input[indices[j]] for j from
+    // offsets[i] to offsets[i + 1] - 1 (an input vertex can appear more than once)
+    void getStencils(QVector<int> &offsets, QVector<int> &indices, QVector<float> &weights) const;
+
 private:
-    QList<CatmullVertex> vertices;
-    QMap<QPair<int, int>, CatmullEdge> edges;
-    QList<Vertex> facePoints;
-    QList<CatmullFace> faces;
+    QVector<Vertex> original; // the input vertices (shared with the input mesh)
+    bool hasWeights; // false if no input vertex has joint weights, skips all weight math
+
+    // faces are the input triangles followed by the input quads, face f
+    // owns corners faceStart[f] to faceStart[f + 1] - 1
+    QVector<int> faceStart;
+    QVector<int> cornerPoint; // vertex index of each corner
+    QVector<int> cornerFace; // face of each corner
+    QVector<int> cornerEdge; // edge from each corner to the next one in its face
+
+    // sorted by (points[0], points[1])
+    QVector<CatmullEdge> edges;
+
+    // temporaries for building the edge table: the corners are bucketed by the
+    // lower vertex of their outgoing edge, with the higher vertex as the key
+    QVector<int> bucketStart;
+    QVector<int> bucketKeys;
+    QVector<int> bucketCorners;
+    QVector<int> bucketEdgeStart; // first edge of each bucket, -1 before the prefix sum if invalid
+
+    // the corners touching vertex v, in face order, are vertexCorners[vertexStart[v]]
+    // to vertexCorners[vertexStart[v + 1] - 1], the edges touching v are stored
+    // in the first vertexEdgeCount[v] of the twice as many slots in vertexEdges
+    QVector<int> vertexStart;
+    QVector<int> vertexCorners;
+    QVector<int> vertexEdges;
+    QVector<int> vertexEdgeCount;
+
+    // the subdivided vertices: moved original vertices, then edge points, then face points
+    QVector<Vertex> points;
+    QVector<Quad> quads;
+    int edgeOffset, faceOffset;
     bool valid;
 
-    bool moveVertices();
+    bool buildEdges();
+    void convertToAdaptiveMesh(Mesh &m, QVector<bool> refine);
+    void buildVertexAdjacency();
+
+    // each of these handles the vertices, edges or faces in [begin, end)
+    void sortEdgeBuckets(int begin, int end);
+    void emitEdges(int begin, int end);
+    void gatherVertexEdges(int begin, int end);
+    void computeFacePoints(int begin, int end);
+    void computeEdgePoints(int begin, int end);
+    void moveVertices(int begin, int end);
+    void emitQuads(int begin, int end);
+
+    void addFaceStencil(int face, float weight, QVector<int> &indices, QVector<float> &weights) const;
+    void addEdgeStencil(int edge, float weight, QVector<int> &indices, QVector<float> &weights) const;
 };
 
 #endif // CATMULLCLARK_H
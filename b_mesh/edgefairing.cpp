@@ -1,79 +1,160 @@
 #include "edgefairing.h"
+#include "profiler.h"
+#include "parallel.h"
 #include <QtAlgorithms>
 
-// helper to sort vertices by their rotation in a coordinate system
+// runImplicit() stops once the residual is this fraction of the one for not
+// moving at all, or after this many iterations
+#define IMPLICIT_FAIRING_TOLERANCE 1e-6f
+#define IMPLICIT_FAIRING_MAX_ITERATIONS 200
+
+// helper to sort neighbors by their rotation in a coordinate system
 struct rotationInCoordinateSystem
 {
+    const QVector<Vertex> &vertices;
     Vector3 origin, axisX, axisY;
 
-    rotationInCoordinateSystem(const Vector3 &origin, const Vector3 &axisX, const Vector3 &axisY) : origin(origin), axisX(axisX), axisY(axisY) {}
+    rotationInCoordinateSystem(const QVector<Vertex> &vertices, const Vector3 &origin, const Vector3 &axisX, const Vector3 &axisY) :
+        vertices(vertices), origin(origin), axisX(axisX), axisY(axisY) {}
 
-    bool operator () (const Vector3 &a, const Vector3 &b)
+    bool operator () (int a, int b)
     {
-        float angleA = atan2f(axisX.dot(a - origin), axisY.dot(a - origin));
-        float angleB = atan2f(axisX.dot(b - origin), axisY.dot(b - origin));
+        float angleA = atan2f(axisX.dot(vertices[a].pos - origin), axisY.dot(vertices[a].pos - origin));
+        float angleB = atan2f(axisX.dot(vertices[b].pos - origin), axisY.dot(vertices[b].pos - origin));
         return angleA < angleB;
     }
 };
 
-void EdgeFairing::computeNeighbors()
+// every face corner knows its face and the neighbors before and after it in the face
+static void addCorner(QVector<int> &cursor, QVector<int> &faces, QVector<int> &before, QVector<int> &after, int vertex, int face, int prev, int next)
 {
-    vertexInfo.resize(mesh.vertices.count());
+    int i = cursor[vertex]++;
+    faces[i] = face;
+    before[i] = prev;
+    after[i] = next;
+}
 
+EdgeFairing::EdgeFairing(Mesh &mesh) : mesh(mesh), vertices(NULL), lambda(0), activeVertices(NULL), activeFaces(NULL)
+{
+    computeNeighbors();
+}
+
+void EdgeFairing::computeNeighbors()
+{
+    int numVertices = mesh.vertices.count();
+    int numTriangles = mesh.triangles.count();
+    faceOffsets.fill(0, numVertices + 1);
     foreach (const Triangle &tri, mesh.triangles)
     {
-        vertexInfo[tri.a.index].neighbors += tri.b.index;
-        vertexInfo[tri.a.index].neighbors += tri.c.index;
-
-        vertexInfo[tri.b.index].neighbors += tri.c.index;
-        vertexInfo[tri.b.index].neighbors += tri.a.index;
-
-        vertexInfo[tri.c.index].neighbors += tri.a.index;
-        vertexInfo[tri.c.index].neighbors += tri.b.index;
+        faceOffsets[tri.a.index + 1]++;
+        faceOffsets[tri.b.index + 1]++;
+        faceOffsets[tri.c.index + 1]++;
     }
-
     foreach (const Quad &quad, mesh.quads)
     {
-        vertexInfo[quad.a.index].neighbors += quad.b.index;
-        vertexInfo[quad.a.index].neighbors += quad.d.index;
-
-        vertexInfo[quad.b.index].neighbors += quad.c.index;
-        vertexInfo[quad.b.index].neighbors += quad.a.index;
-
-        vertexInfo[quad.c.index].neighbors += quad.d.index;
-        vertexInfo[quad.c.index].neighbors += quad.b.index;
+        faceOffsets[quad.a.index + 1]++;
+        faceOffsets[quad.b.index + 1]++;
+        faceOffsets[quad.c.index + 1]++;
+        faceOffsets[quad.d.index + 1]++;
+    }
+    for (int i = 0; i < numVertices; i++)
+        faceOffsets[i + 1] += faceOffsets[i];
 
-        vertexInfo[quad.d.index].neighbors += quad.a.index;
-        vertexInfo[quad.d.index].neighbors += quad.c.index;
+    QVector<int> cursor = faceOffsets;
+    vertexFaces.resize(faceOffsets[numVertices]);
+    QVector<int> before(faceOffsets[numVertices]), after(faceOffsets[numVertices]);
+    for (int i = 0; i < numTriangles; i++)
+    {
+        const Triangle &tri = mesh.triangles[i];
+        addCorner(cursor, vertexFaces, before, after, tri.a.index, i, tri.c.index, tri.b.index);
+        addCorner(cursor, vertexFaces, before, after, tri.b.index, i, tri.a.index, tri.c.index);
+        addCorner(cursor, vertexFaces, before, after, tri.c.index, i, tri.b.index, tri.a.index);
+    }
+    for (int i = 0; i < mesh.quads.count(); i++)
+    {
+        const Quad &quad = mesh.quads[i];
+        int face = numTriangles + i;
+        addCorner(cursor, vertexFaces, before, after, quad.a.index, face, quad.d.index, quad.b.index);
+        addCorner(cursor, vertexFaces, before, after, quad.b.index, face, quad.a.index, quad.c.index);
+        addCorner(cursor, vertexFaces, before, after, quad.c.index, face, quad.b.index, quad.d.index);
+        addCorner(cursor, vertexFaces, before, after, quad.d.index, face, quad.c.index, quad.a.index);
     }
-}
 
-void EdgeFairing::iterate()
-{
-    for (int i = 0; i < vertexInfo.count(); i++)
+    neighborOffsets.resize(numVertices + 1);
+    neighbors.clear();
+    neighbors.reserve(faceOffsets[numVertices]);
+    nextPositions.resize(numVertices);
+    faceNormals.resize(numTriangles + mesh.quads.count());
+    QVector<int> ring;
+
+    for (int i = 0; i < numVertices; i++)
     {
-        Vertex &vertex = mesh.vertices[i];
-        VertexInfo &info = vertexInfo[i];
+        neighborOffsets[i] = neighbors.count();
+        int first = faceOffsets[i], count = faceOffsets[i + 1] - first;
 
-        // special-case vertices with valence 4
-        if (info.neighbors.count() == 4)
+        // walk around the vertex, from each face to the one sharing the edge
+        // to its next neighbor, which works if the faces form a closed fan
+        ring.clear();
+        bool closed = count > 0;
+        int corner = first;
+        for (int step = 0; closed && step < count; step++)
+        {
+            ring += after[corner];
+            int next = -1;
+            for (int j = first; j < first + count; j++)
+            {
+                if (before[j] == after[corner])
+                {
+                    next = j;
+                    break;
+                }
+            }
+            closed = next != -1 && (next == first) == (step == count - 1);
+            corner = next;
+        }
+
+        // otherwise (borders, non-manifold or inconsistently oriented faces)
+        // just collect the neighbors, sorted around the normal at valence 4
+        if (!closed)
         {
-            // project the neighbors onto the tangent plane
-            QVector<Vector3> projectedNeighbors;
-            foreach (int neighbor, info.neighbors)
+            ring.clear();
+            for (int j = first; j < first + count; j++)
+            {
+                if (!ring.contains(before[j])) ring += before[j];
+                if (!ring.contains(after[j])) ring += after[j];
+            }
+            if (ring.count() == 4)
             {
-                Vector3 &pos = mesh.vertices[neighbor].pos;
-                projectedNeighbors += pos + vertex.normal * (vertex.pos - pos).dot(vertex.normal);
+                const Vertex &vertex = mesh.vertices[i];
+                Vector3 axisX = (mesh.vertices[ring[0]].pos - vertex.pos).unit();
+                axisX = (axisX - vertex.normal * axisX.dot(vertex.normal)).unit();
+                Vector3 axisY = vertex.normal.cross(axisX);
+                qSort(ring.begin(), ring.end(), rotationInCoordinateSystem(mesh.vertices, vertex.pos, axisX, axisY));
             }
+        }
+        neighbors += ring;
+    }
+    neighborOffsets[numVertices] = neighbors.count();
+}
 
-            // define a tangent-space coordinate system
-            Vector3 axisX = (projectedNeighbors[0] - vertex.pos).unit();
-            Vector3 axisY = vertex.normal.cross(axisX);
+void EdgeFairing::computeNextPositions(int begin, int end)
+{
+    const int *offsets = neighborOffsets.constData();
+    const int *rings = neighbors.constData();
+    Vector3 *nextPos = nextPositions.data();
 
-            // sort the vertices by their rotation in the tangent-space coordinate system
-            qSort(projectedNeighbors.begin(), projectedNeighbors.end(), rotationInCoordinateSystem(vertex.pos, axisX, axisY));
+    for (int k = begin; k < end; k++)
+    {
+        int i = activeVertices ? activeVertices[k] : k;
+        const Vertex &vertex = vertices[i];
+        const int *ring = rings + offsets[i];
+        int count = offsets[i + 1] - offsets[i];
 
-            // we now have vectors in clockwise or counter-clockwise order
+        // special-case vertices with valence 4
+        if (count == 4)
+        {
+            // project the neighbors onto the tangent plane, they are already
+            // in clockwise or counter-clockwise order
             //
             //      b
             //      |
@@ -81,10 +162,16 @@ void EdgeFairing::iterate()
             //      |
             //      d
             //
-            Vector3 &a = projectedNeighbors[0];
-            Vector3 &b = projectedNeighbors[1];
-            Vector3 &c = projectedNeighbors[2];
-            Vector3 &d = projectedNeighbors[3];
+            Vector3 projected[4];
+            for (int j = 0; j < 4; j++)
+            {
+                const Vector3 &pos = vertices[ring[j]].pos;
+                projected[j] = pos + vertex.normal * (vertex.pos - pos).dot(vertex.normal);
+            }
+            const Vector3 &a = projected[0];
+            const Vector3 &b = projected[1];
+            const Vector3 &c = projected[2];
+            const Vector3 &d = projected[3];
 
             // set the vertex to the intersection of the lines between the two opposite neighbor pairs
             // blend between the intersection and the average for stability
@@ -92,35 +179,333 @@ void EdgeFairing::iterate()
             float t = (a - b).dot(normal) / (d - b).dot(normal);
             Vector3 intersection = b + (d - b) * max(0, min(1, t));
             Vector3 average = (a + b + c + d) / 4;
-            info.nextPos = (average + intersection) / 2;
+            nextPos[i] = (average + intersection) / 2;
         }
-        else
+        else if (count > 0)
         {
             // calculate the average neighbor vertex position
             Vector3 average;
-            foreach (int neighbor, info.neighbors)
-                average += mesh.vertices[neighbor].pos;
-            average /= info.neighbors.count();
+            for (int j = 0; j < count; j++)
+                average += vertices[ring[j]].pos;
+            average /= count;
 
             // move the vertex to the average projected onto the tangent plane
             float t = (vertex.pos - average).dot(vertex.normal);
-            info.nextPos = average + vertex.normal * t;
+            nextPos[i] = average + vertex.normal * t;
         }
+        else nextPos[i] = vertex.pos;
     }
+}
 
-    // actually move the vertices (must be done in a separate loop or we would be mutating while iterating)
+void EdgeFairing::moveVertices(int begin, int end)
+{
     // only move a small amount per iteration for stability
-    for (int i = 0; i < vertexInfo.count(); i++)
-        mesh.vertices[i].pos = Vector3::lerp(mesh.vertices[i].pos, vertexInfo[i].nextPos, 0.1);
+    const Vector3 *nextPos = nextPositions.constData();
+    for (int k = begin; k < end; k++)
+    {
+        int i = activeVertices ? activeVertices[k] : k;
+        vertices[i].pos = Vector3::lerp(vertices[i].pos, nextPos[i], 0.1);
+    }
+}
 
-    mesh.updateNormals();
+void EdgeFairing::iterate(int movingCount)
+{
+    // actually move the vertices in a separate pass or we would be mutating while iterating,
+    // which also makes each pass independent per vertex
+    parallelFor(movingCount, this, &EdgeFairing::computeNextPositions);
+    parallelFor(movingCount, this, &EdgeFairing::moveVertices);
 }
 
-void EdgeFairing::run(Mesh &mesh, int iterations)
+// the same face normals as Mesh::updateNormals()
+void EdgeFairing::computeFaceNormals(int begin, int end)
 {
+    int numTriangles = mesh.triangles.count();
+    const Triangle *triangles = mesh.triangles.constData();
+    const Quad *quads = mesh.quads.constData();
+    Vector3 *normals = faceNormals.data();
+
+    for (int k = begin; k < end; k++)
+    {
+        int i = activeFaces ? activeFaces[k] : k;
+        if (i < numTriangles)
+        {
+            const Triangle &tri = triangles[i];
+            const Vector3 &a = vertices[tri.a.index].pos;
+            normals[i] = (vertices[tri.b.index].pos - a).cross(vertices[tri.c.index].pos - a).unit();
+        }
+        else
+        {
+            const Quad &quad = quads[i - numTriangles];
+            const Vector3 &a = vertices[quad.a.index].pos;
+            const Vector3 &b = vertices[quad.b.index].pos;
+            const Vector3 &c = vertices[quad.c.index].pos;
+            const Vector3 &d = vertices[quad.d.index].pos;
+            normals[i] = (
+                    (b - a).cross(d - a) +
+                    (c - b).cross(a - b) +
+                    (d - c).cross(b - c) +
+                    (a - d).cross(c - d)
+                ).unit();
+        }
+    }
+}
+
+// each vertex adds up its own faces, so unlike Mesh::updateNormals() no two
+// threads ever write to the same vertex
+void EdgeFairing::gatherNormals(int begin, int end)
+{
+    const int *offsets = faceOffsets.constData();
+    const int *faces = vertexFaces.constData();
+    const Vector3 *normals = faceNormals.constData();
+
+    for (int k = begin; k < end; k++)
+    {
+        int i = activeVertices ? activeVertices[k] : k;
+        Vector3 normal;
+        for (int j = offsets[i]; j < offsets[i + 1]; j++)
+            normal += normals[faces[j]];
+        normal.normalize();
+        vertices[i].normal = normal;
+    }
+}
+
+void EdgeFairing::updateNormals(int vertexCount, int faceCount)
+{
+    parallelFor(faceCount, this, &EdgeFairing::computeFaceNormals);
+    parallelFor(vertexCount, this, &EdgeFairing::gatherNormals);
+}
+
+void EdgeFairing::run(Mesh &mesh, int iterations, int normalInterval)
+{
+    PROFILE_SCOPE("EdgeFairing::run");
     EdgeFairing edgeFairing(mesh);
-    edgeFairing.computeNeighbors();
 
+    // detach once here, not from every thread
+    edgeFairing.vertices = mesh.vertices.data();
+    normalInterval = qMax(1, normalInterval);
+    for (int i = 0; i < iterations; i++)
+    {
+        edgeFairing.iterate(edgeFairing.nextPositions.count());
+        if ((i + 1) % normalInterval == 0 || i == iterations - 1)
+            edgeFairing.updateNormals(edgeFairing.nextPositions.count(), edgeFairing.faceNormals.count());
+    }
+}
+
+static void addOnce(QVector<char> &marks, QVector<int> &list, int index)
+{
+    if (marks[index]) return;
+    marks[index] = true;
+    list += index;
+}
+
+void EdgeFairing::runRegion(const QVector<int> &seeds, int rings, int iterations, int normalInterval)
+{
+    PROFILE_SCOPE("EdgeFairing::runRegion");
+    int numVertices = nextPositions.count();
+    int numTriangles = mesh.triangles.count();
+    const Triangle *triangles = mesh.triangles.constData();
+    const Quad *quads = mesh.quads.constData();
+    if (vertexInRegion.count() != numVertices) vertexInRegion.fill(false, numVertices);
+    if (faceInRegion.count() != faceNormals.count()) faceInRegion.fill(false, faceNormals.count());
+
+    // grow the seeds breadth-first, the vertices added by the last step are
+    // the fixed boundary
+    regionVertices.clear();
+    foreach (int seed, seeds)
+        if (seed >= 0 && seed < numVertices) addOnce(vertexInRegion, regionVertices, seed);
+    int ringStart = 0, movingCount = 0;
+    for (int ring = 0; ring <= qMax(rings, 0); ring++)
+    {
+        int ringEnd = movingCount = regionVertices.count();
+        for (int k = ringStart; k < ringEnd; k++)
+        {
+            int i = regionVertices[k];
+            for (int j = neighborOffsets[i]; j < neighborOffsets[i + 1]; j++)
+                addOnce(vertexInRegion, regionVertices, neighbors[j]);
+        }
+        ringStart = ringEnd;
+    }
+
+    // every corner of a face around a moving vertex needs a new normal, which
+    // reaches past the boundary across the diagonals of quads, and those
+    // normals need every face around them
+    regionFaces.clear();
+    for (int k = 0; k < movingCount; k++)
+    {
+        int i = regionVertices[k];
+        for (int j = faceOffsets[i]; j < faceOffsets[i + 1]; j++)
+        {
+            int face = vertexFaces[j];
+            if (faceInRegion[face]) continue;
+            faceInRegion[face] = true;
+            regionFaces += face;
+            if (face < numTriangles)
+            {
+                const Triangle &tri = triangles[face];
+                addOnce(vertexInRegion, regionVertices, tri.a.index);
+                addOnce(vertexInRegion, regionVertices, tri.b.index);
+                addOnce(vertexInRegion, regionVertices, tri.c.index);
+            }
+            else
+            {
+                const Quad &quad = quads[face - numTriangles];
+                addOnce(vertexInRegion, regionVertices, quad.a.index);
+                addOnce(vertexInRegion, regionVertices, quad.b.index);
+                addOnce(vertexInRegion, regionVertices, quad.c.index);
+                addOnce(vertexInRegion, regionVertices, quad.d.index);
+            }
+        }
+    }
+    for (int k = movingCount; k < regionVertices.count(); k++)
+    {
+        int i = regionVertices[k];
+        for (int j = faceOffsets[i]; j < faceOffsets[i + 1]; j++)
+            addOnce(faceInRegion, regionFaces, vertexFaces[j]);
+    }
+    PROFILE_COUNTER("fairing region vertices", movingCount);
+
+    vertices = mesh.vertices.data();
+    activeVertices = regionVertices.constData();
+    activeFaces = regionFaces.constData();
+    normalInterval = qMax(1, normalInterval);
     for (int i = 0; i < iterations; i++)
-        edgeFairing.iterate();
+    {
+        iterate(movingCount);
+        if ((i + 1) % normalInterval == 0 || i == iterations - 1)
+            updateNormals(regionVertices.count(), regionFaces.count());
+    }
+    activeVertices = activeFaces = NULL;
+
+    // only clear the marks that were set so the next call is just as cheap
+    foreach (int i, regionVertices)
+        vertexInRegion[i] = false;
+    foreach (int face, regionFaces)
+        faceInRegion[face] = false;
+}
+
+// (I + lambda L) x = x0 is multiplied through by the vertex valences, which
+// makes it symmetric: valence * x - lambda * (sum of neighbors - valence * x).
+// Isolated vertices get a weight of one so they stay where they are.
+static float diagonal(int count, float lambda)
+{
+    return (count > 0 ? count : 1) + lambda * count;
+}
+
+void EdgeFairing::multiply(int begin, int end)
+{
+    const int *offsets = neighborOffsets.constData();
+    const int *rings = neighbors.constData();
+    const Vector3 *p = direction.constData();
+    Vector3 *q = product.data();
+
+    for (int i = begin; i < end; i++)
+    {
+        Vector3 sum;
+        for (int j = offsets[i]; j < offsets[i + 1]; j++)
+            sum += p[rings[j]];
+        q[i] = p[i] * diagonal(offsets[i + 1] - offsets[i], lambda) - sum * lambda;
+    }
+}
+
+// the x, y and z systems are solved side by side, so dot products are per component
+static Vector3 componentDot(const QVector<Vector3> &a, const QVector<Vector3> &b)
+{
+    double x = 0, y = 0, z = 0;
+    for (int i = 0; i < a.count(); i++)
+    {
+        x += a[i].x * b[i].x;
+        y += a[i].y * b[i].y;
+        z += a[i].z * b[i].z;
+    }
+    return Vector3(x, y, z);
+}
+
+static Vector3 divideOrZero(const Vector3 &a, const Vector3 &b)
+{
+    return Vector3(b.x ? a.x / b.x : 0, b.y ? a.y / b.y : 0, b.z ? a.z / b.z : 0);
+}
+
+int EdgeFairing::solveImplicit(const QVector<Vector3> *guess)
+{
+    int count = nextPositions.count();
+    const int *offsets = neighborOffsets.constData();
+    bool useGuess = guess && guess->count() == count;
+    residual.resize(count);
+    preconditioned.resize(count);
+    direction.resize(count);
+    product.resize(count);
+
+    // The residual b - M x0 of not moving at all is lambda times the
+    // Laplacian of x0, which measures how much smoothing there is to do and
+    // doesn't change when the model is moved. Stop relative to that, even
+    // when starting from a guess, so a good guess means fewer iterations.
+    Vector3 *x = nextPositions.data();
+    for (int i = 0; i < count; i++)
+        direction[i] = x[i] = vertices[i].pos;
+    parallelFor(count, this, &EdgeFairing::multiply);
+    for (int i = 0; i < count; i++)
+        residual[i] = vertices[i].pos * diagonal(offsets[i + 1] - offsets[i], 0) - product[i];
+    Vector3 r0 = componentDot(residual, residual);
+    float tolerance = sqrtf(r0.x + r0.y + r0.z) * IMPLICIT_FAIRING_TOLERANCE;
+
+    // start from x0 plus the guess instead
+    if (useGuess)
+    {
+        for (int i = 0; i < count; i++)
+            direction[i] = x[i] = vertices[i].pos + (*guess)[i];
+        parallelFor(count, this, &EdgeFairing::multiply);
+        for (int i = 0; i < count; i++)
+            residual[i] = vertices[i].pos * diagonal(offsets[i + 1] - offsets[i], 0) - product[i];
+    }
+
+    // preconditioned conjugate gradients with the diagonal as the preconditioner
+    for (int i = 0; i < count; i++)
+        direction[i] = preconditioned[i] = residual[i] / diagonal(offsets[i + 1] - offsets[i], lambda);
+    Vector3 rz = componentDot(residual, preconditioned);
+
+    int iteration = 0;
+    for (; iteration < IMPLICIT_FAIRING_MAX_ITERATIONS; iteration++)
+    {
+        Vector3 rr = componentDot(residual, residual);
+        if (sqrtf(rr.x + rr.y + rr.z) <= tolerance)
+            break;
+
+        parallelFor(count, this, &EdgeFairing::multiply);
+        Vector3 alpha = divideOrZero(rz, componentDot(direction, product));
+        for (int i = 0; i < count; i++)
+        {
+            x[i] += alpha * direction[i];
+            residual[i] -= alpha * product[i];
+            preconditioned[i] = residual[i] / diagonal(offsets[i + 1] - offsets[i], lambda);
+        }
+
+        Vector3 next = componentDot(residual, preconditioned);
+        Vector3 beta = divideOrZero(next, rz);
+        rz = next;
+        for (int i = 0; i < count; i++)
+            direction[i] = preconditioned[i] + beta * direction[i];
+    }
+    return iteration;
+}
+
+int EdgeFairing::runImplicit(Mesh &mesh, float lambda, QVector<Vector3> *guess)
+{
+    PROFILE_SCOPE("EdgeFairing::runImplicit");
+    EdgeFairing edgeFairing(mesh);
+    edgeFairing.vertices = mesh.vertices.data();
+    edgeFairing.lambda = qMax(lambda, 0.0f);
+    int iterations = edgeFairing.solveImplicit(guess);
+    PROFILE_COUNTER("implicit fairing iterations", iterations);
+
+    // keep the part of each move along the surface
+    if (guess) guess->resize(mesh.vertices.count());
+    for (int i = 0; i < mesh.vertices.count(); i++)
+    {
+        Vertex &vertex = edgeFairing.vertices[i];
+        Vector3 move = edgeFairing.nextPositions[i] - vertex.pos;
+        if (guess) (*guess)[i] = move;
+        vertex.pos += move - vertex.normal * move.dot(vertex.normal);
+    }
+    edgeFairing.updateNormals(edgeFairing.nextPositions.count(), edgeFairing.faceNormals.count());
+    return iterations;
 }
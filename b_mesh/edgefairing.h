@@ -2,26 +2,79 @@
 #define EDGEFAIRING_H
 
 #include "document.h"
-#include <QSet>
-
-struct VertexInfo
-{
-    Vector3 nextPos;
-    QSet<int> neighbors;
-};
 
 class EdgeFairing
 {
 private:
     Mesh &mesh;
-    QVector<VertexInfo> vertexInfo;
 
-    EdgeFairing(Mesh &mesh) : mesh(mesh) {}
+    // the neighbors of vertex i are neighbors[neighborOffsets[i]] up to
+    // neighbors[neighborOffsets[i + 1]], in order around the vertex
+    QVector<int> neighborOffsets;
+    QVector<int> neighbors;
+
+    // the faces around each vertex the same way (triangles come first, then
+    // quads offset by the number of triangles), in the order Mesh::updateNormals()
+    // adds them up so the normals come out the same
+    QVector<int> faceOffsets;
+    QVector<int> vertexFaces;
+
+    Vertex *vertices;
+    QVector<Vector3> nextPositions;
+    QVector<Vector3> faceNormals;
+
+    // conjugate gradient state for runImplicit(), the solution is in nextPositions
+    float lambda;
+    QVector<Vector3> residual, preconditioned, direction, product;
+
+    // runRegion() only visits these vertices and faces, the passes use all of
+    // them when activeVertices is NULL
+    QVector<int> regionVertices, regionFaces;
+    const int *activeVertices, *activeFaces;
+    QVector<char> vertexInRegion, faceInRegion;
+
     void computeNeighbors();
-    void iterate();
+    void iterate(int movingCount);
+    void updateNormals(int vertexCount, int faceCount);
+
+    // the passes of iterate() and updateNormals(), over ranges of vertices or faces
+    void computeNextPositions(int begin, int end);
+    void moveVertices(int begin, int end);
+    void computeFaceNormals(int begin, int end);
+    void gatherNormals(int begin, int end);
+    int solveImplicit(const QVector<Vector3> *guess);
+    void multiply(int begin, int end);
 
 public:
-    static void run(Mesh &mesh, int iterations);
+    // Finds the neighbors of every vertex, which is all the work that depends
+    // on the size of the mesh. Keep one around to call runRegion() on the same
+    // mesh repeatedly, as long as its faces don't change.
+    EdgeFairing(Mesh &mesh);
+
+    // Fairs only the vertices within rings edges of the seeds the same way as
+    // run(), leaving everything else (including the ring of vertices just
+    // outside, which acts as a fixed boundary) where it is. Normals are only
+    // refreshed around the region. Takes time proportional to the region.
+    void runRegion(const QVector<int> &seeds, int rings, int iterations, int normalInterval = 1);
+
+    // Each iteration moves every vertex a bit towards the average of its
+    // neighbors, or for valence 4 towards where the lines between opposite
+    // neighbors cross, within the tangent plane. Normals are refreshed every
+    // normalInterval iterations and after the last one, so 1 matches calling
+    // Mesh::updateNormals() after every iteration. Larger intervals are
+    // cheaper but use slightly stale tangent planes.
+    static void run(Mesh &mesh, int iterations, int normalInterval = 1);
+
+    // Smooths about as much as lambda / 0.1 iterations of run() in one step by
+    // solving (I + lambda L) x = x0, where L is the uniform Laplacian over the
+    // neighbors (there is no valence 4 special case), with conjugate gradients.
+    // The tangent plane projection is not part of that operator, which keeps
+    // it symmetric, but applied after the solve: each vertex only keeps the
+    // part of its move within its tangent plane. guess, if given, is the move
+    // to start from (the one from a previous call on a similar mesh is a good
+    // start) and gets this call's. Returns the number of conjugate gradient
+    // iterations.
+    static int runImplicit(Mesh &mesh, float lambda, QVector<Vector3> *guess = NULL);
 };
 
 #endif // EDGEFAIRING_H
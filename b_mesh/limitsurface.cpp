@@ -0,0 +1,600 @@
+#include "limitsurface.h"
+#include "catmullclark.h"
+#include "parallel.h"
+#include "profiler.h"
+#include <QHash>
+#include <QPair>
+#include <math.h>
+
+// positions of the quad corners in a face's (u, v) grid, in winding order
+static const int cornerX[4] = { 0, 1, 1, 0 };
+static const int cornerY[4] = { 0, 0, 1, 1 };
+
+static inline int quadCorner(const Quad &quad, int i)
+{
+    switch (i & 3)
+    {
+    case 0: return quad.a.index;
+    case 1: return quad.b.index;
+    case 2: return quad.c.index;
+    default: return quad.d.index;
+    }
+}
+
+// the same face normal Mesh::updateNormals() uses
+static Vector3 quadNormal(const Vector3 &a, const Vector3 &b, const Vector3 &c, const Vector3 &d)
+{
+    return ((b - a).cross(d - a) + (c - b).cross(a - b) + (d - c).cross(b - c) + (a - d).cross(c - d)).unit();
+}
+
+// the quads around each vertex of an all-quad mesh, stored as quad * 4 + corner
+// and in quad order
+struct QuadAdjacency
+{
+    const Quad *quads;
+    QVector<int> start;
+    QVector<int> corners;
+
+    void build(const QVector<Quad> &quadList, int numVertices)
+    {
+        quads = quadList.constData();
+        start.fill(0, numVertices + 1);
+        for (int q = 0; q < quadList.count(); q++)
+            for (int i = 0; i < 4; i++)
+                start[quadCorner(quads[q], i) + 1]++;
+        for (int v = 0; v < numVertices; v++)
+            start[v + 1] += start[v];
+
+        QVector<int> fill(start);
+        corners.resize(quadList.count() * 4);
+        for (int q = 0; q < quadList.count(); q++)
+            for (int i = 0; i < 4; i++)
+                corners[fill[quadCorner(quads[q], i)]++] = q * 4 + i;
+    }
+
+    int valence(int v) const { return start[v + 1] - start[v]; }
+    int firstQuad(int v) const { return corners[start[v]] / 4; }
+
+    // walks around v in winding order starting at the given quad corner: quad j
+    // lies between the neighbors edges[j] and edges[j + 1] and diagonals[j] is
+    // its corner opposite v, returns false unless the quads form one closed fan
+    bool ring(int v, int first, QVector<int> &edges, QVector<int> &diagonals) const
+    {
+        int begin = start[v], end = start[v + 1];
+        edges.resize(0);
+        diagonals.resize(0);
+
+        int current = first;
+        for (int step = 0; step < end - begin; step++)
+        {
+            const Quad &quad = quads[current / 4];
+            int r = current % 4;
+            edges += quadCorner(quad, r + 1);
+            diagonals += quadCorner(quad, r + 2);
+
+            // the next quad starts with the edge this one ends with
+            int previous = quadCorner(quad, r + 3);
+            current = -1;
+            for (int i = begin; i < end; i++)
+            {
+                if (quadCorner(quads[corners[i] / 4], corners[i] % 4 + 1) == previous)
+                {
+                    current = corners[i];
+                    break;
+                }
+            }
+            if (current == -1 || (current == first) != (step + 1 == end - begin))
+                return false;
+        }
+        return true;
+    }
+};
+
+// limit position and normal of vertex v from its ring of quads, see "Efficient,
+// Fair Interpolation using Catmull-Clark Surfaces" by Halstead et al.
+static void interiorLimit(const Vertex *vertices, int v, const QVector<int> &edges, const QVector<int> &diagonals,
+    Vector3 &pos, Vector3 &normal)
+{
+    int n = edges.count();
+    float c = cosf(2 * M_PI / n);
+    float a = 1 + c + cosf(M_PI / n) * sqrtf(2 * (9 + c));
+    Vector3 edgeSum, diagonalSum, tangentU, tangentV;
+
+    for (int j = 0; j < n; j++)
+    {
+        const Vector3 &e = vertices[edges[j]].pos;
+        const Vector3 &f = vertices[diagonals[j]].pos;
+        float angle = 2 * M_PI * j / n, nextAngle = 2 * M_PI * (j + 1) / n;
+        edgeSum += e;
+        diagonalSum += f;
+        tangentU += e * (a * cosf(angle)) + f * (cosf(angle) + cosf(nextAngle));
+        tangentV += e * (a * sinf(angle)) + f * (sinf(angle) + sinf(nextAngle));
+    }
+
+    pos = (vertices[v].pos * (float)(n * n) + edgeSum * 4 + diagonalSum) / (float)(n * (n + 5));
+    normal = tangentU.cross(tangentV).unit();
+}
+
+// border vertices sit on a cubic B-spline (that is what CatmullMesh does along
+// borders), anything else that isn't a closed fan keeps its position
+static void borderLimit(const Vertex *vertices, const QuadAdjacency &adjacency, int v, Vector3 &pos, Vector3 &normal)
+{
+    QVector<int> nexts, previouses;
+    normal = Vector3();
+    for (int i = adjacency.start[v]; i < adjacency.start[v + 1]; i++)
+    {
+        const Quad &quad = adjacency.quads[adjacency.corners[i] / 4];
+        int r = adjacency.corners[i] % 4;
+        nexts += quadCorner(quad, r + 1);
+        previouses += quadCorner(quad, r + 3);
+        normal += quadNormal(vertices[quad.a.index].pos, vertices[quad.b.index].pos, vertices[quad.c.index].pos, vertices[quad.d.index].pos);
+    }
+    normal.normalize();
+
+    // border edges are only used by one quad, so they appear on one side only
+    QVector<int> border;
+    foreach (int next, nexts)
+        if (!previouses.contains(next)) border += next;
+    foreach (int previous, previouses)
+        if (!nexts.contains(previous)) border += previous;
+
+    pos = vertices[v].pos;
+    if (border.count() == 2)
+        pos = (vertices[border[0]].pos + pos * 4 + vertices[border[1]].pos) / 6;
+}
+
+// one step of textbook Catmull-Clark on an all-quad mesh, positions only.
+// CatmullMesh averages edge points instead of edge midpoints when moving
+// vertices, which doesn't converge to the bicubic patches, so the irregular
+// quads are refined with the standard rules here. Like CatmullMesh, corner r
+// of quad q becomes quad 4q + r, starting at that corner.
+static void subdivideQuads(Mesh &mesh)
+{
+    int numVertices = mesh.vertices.count();
+    int numQuads = mesh.quads.count();
+    const Vertex *vertices = mesh.vertices.constData();
+    const Quad *quadList = mesh.quads.constData();
+    QuadAdjacency adjacency;
+    adjacency.build(mesh.quads, numVertices);
+
+    // an edge belongs to the first corner that uses it, in either direction
+    QVector<int> cornerEdge(numQuads * 4, -1);
+    QVector<int> edgeCorner;
+    QVector<char> edgeBorder;
+    for (int c = 0; c < numQuads * 4; c++)
+    {
+        if (cornerEdge[c] != -1) continue;
+        int a = quadCorner(quadList[c / 4], c % 4), b = quadCorner(quadList[c / 4], c % 4 + 1);
+        int edge = edgeCorner.count();
+        cornerEdge[c] = edge;
+        edgeCorner += c;
+        edgeBorder += 1;
+        for (int i = adjacency.start[b]; i < adjacency.start[b + 1]; i++)
+        {
+            int twin = adjacency.corners[i];
+            if (twin > c && cornerEdge[twin] == -1 && quadCorner(quadList[twin / 4], twin % 4 + 1) == a)
+            {
+                cornerEdge[twin] = edge;
+                edgeBorder.last() = 0;
+                break;
+            }
+        }
+    }
+
+    int edgeOffset = numVertices, faceOffset = numVertices + edgeCorner.count();
+    QVector<Vertex> next(faceOffset + numQuads);
+    for (int q = 0; q < numQuads; q++)
+    {
+        const Quad &quad = quadList[q];
+        next[faceOffset + q].pos = (vertices[quad.a.index].pos + vertices[quad.b.index].pos + vertices[quad.c.index].pos + vertices[quad.d.index].pos) / 4;
+    }
+
+    // interior edges are shared by exactly two quads, so the edge point
+    // averages the endpoints with the face points on either side
+    QVector<Vector3> faceSum(edgeCorner.count());
+    for (int c = 0; c < numQuads * 4; c++)
+        faceSum[cornerEdge[c]] += next[faceOffset + c / 4].pos;
+    for (int e = 0; e < edgeCorner.count(); e++)
+    {
+        int c = edgeCorner[e];
+        Vector3 ends = vertices[quadCorner(quadList[c / 4], c % 4)].pos + vertices[quadCorner(quadList[c / 4], c % 4 + 1)].pos;
+        next[edgeOffset + e].pos = edgeBorder[e] ? ends / 2 : (ends + faceSum[e]) / 4;
+    }
+
+    QVector<int> edges, diagonals;
+    for (int v = 0; v < numVertices; v++)
+    {
+        const Vector3 &pos = vertices[v].pos;
+        int n = adjacency.valence(v);
+        if (n > 0 && adjacency.ring(v, adjacency.corners[adjacency.start[v]], edges, diagonals))
+        {
+            // Pnew = (F + 2R + (n - 3)P) / n with R the average edge midpoint
+            Vector3 faces, midpoints;
+            for (int i = adjacency.start[v]; i < adjacency.start[v + 1]; i++)
+                faces += next[faceOffset + adjacency.corners[i] / 4].pos;
+            foreach (int neighbor, edges)
+                midpoints += (pos + vertices[neighbor].pos) / 2;
+            next[v].pos = (faces / n + midpoints * (2.0f / n) + pos * (n - 3)) / n;
+            continue;
+        }
+
+        // cubic B-spline along the border, corners and non-manifold vertices stay put
+        QVector<int> border;
+        for (int i = adjacency.start[v]; i < adjacency.start[v + 1]; i++)
+        {
+            int c = adjacency.corners[i];
+            if (edgeBorder[cornerEdge[c]]) border += quadCorner(quadList[c / 4], c % 4 + 1);
+            if (edgeBorder[cornerEdge[c / 4 * 4 + (c + 3) % 4]]) border += quadCorner(quadList[c / 4], c % 4 + 3);
+        }
+        next[v].pos = pos;
+        if (border.count() == 2)
+            next[v].pos = (vertices[border[0]].pos + pos * 6 + vertices[border[1]].pos) / 8;
+    }
+
+    QVector<Quad> quads(numQuads * 4);
+    for (int q = 0; q < numQuads; q++)
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            quads[q * 4 + r] = Quad(quadCorner(quadList[q], r), edgeOffset + cornerEdge[q * 4 + r],
+                faceOffset + q, edgeOffset + cornerEdge[q * 4 + (r + 3) % 4]);
+        }
+    }
+    qSwap(mesh.vertices, next);
+    qSwap(mesh.quads, quads);
+}
+
+class LimitEvaluator
+{
+public:
+    Mesh base;
+    int size; // quads along each side of a base quad
+    int edgeOffset, faceOffset;
+    QuadAdjacency adjacency;
+    QVector<int> cornerEdge; // base edge of each quad corner, to the next corner
+    QVector<int> edgeStart; // the vertex the points on each base edge are numbered from
+    QVector<int> edgeOwner; // the quad that evaluates the points on each base edge
+    QVector<float> basis, derivative; // cubic B-spline basis at each grid coordinate
+
+    // quads next to extraordinary or border vertices, evaluated from a locally subdivided copy
+    QVector<int> irregularIndex; // per base quad, -1 if regular
+    QVector<int> irregularGrid; // local vertex at each grid point of each irregular quad
+    Mesh local;
+    QuadAdjacency localAdjacency;
+    QVector<char> localNeeded;
+    QVector<Vector3> localPos, localNormal;
+
+    Vertex *outVertices;
+    Quad *outQuads;
+
+    bool build(const Mesh &cage, int levels);
+    void buildEdges();
+    void buildBasis();
+    void subdivideIrregular(int levels);
+    void fillGrid(int *grid, int quad, int first, int winding, int x, int y, int cellSize) const;
+    int outputIndex(int face, int x, int y) const;
+    bool owns(int face, int x, int y) const;
+
+    void evaluateLocal(int begin, int end);
+    void evaluateFaces(int begin, int end);
+};
+
+void LimitEvaluator::buildEdges()
+{
+    QHash<QPair<int, int>, int> edgeIndex;
+    cornerEdge.resize(base.quads.count() * 4);
+    for (int q = 0; q < base.quads.count(); q++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            int a = quadCorner(base.quads[q], i), b = quadCorner(base.quads[q], i + 1);
+            QPair<int, int> key(qMin(a, b), qMax(a, b));
+            int edge = edgeIndex.value(key, -1);
+            if (edge == -1)
+            {
+                edge = edgeStart.count();
+                edgeIndex.insert(key, edge);
+                edgeStart += key.first;
+                edgeOwner += q;
+            }
+            cornerEdge[q * 4 + i] = edge;
+        }
+    }
+}
+
+void LimitEvaluator::buildBasis()
+{
+    basis.resize((size + 1) * 4);
+    derivative.resize((size + 1) * 4);
+    for (int i = 0; i <= size; i++)
+    {
+        float t = (float)i / size, s = 1 - t;
+        basis[i * 4 + 0] = s * s * s / 6;
+        basis[i * 4 + 1] = (3 * t * t * t - 6 * t * t + 4) / 6;
+        basis[i * 4 + 2] = (-3 * t * t * t + 3 * t * t + 3 * t + 1) / 6;
+        basis[i * 4 + 3] = t * t * t / 6;
+        derivative[i * 4 + 0] = -s * s / 2;
+        derivative[i * 4 + 1] = (3 * t * t - 4 * t) / 2;
+        derivative[i * 4 + 2] = (-3 * t * t + 2 * t + 1) / 2;
+        derivative[i * 4 + 3] = t * t / 2;
+    }
+}
+
+// stores the local vertex at each grid point of a cell. CatmullMesh turns
+// corner r of quad q into quad 4q + r, which starts at that corner and
+// keeps the winding, so the cells can be followed down without looking at
+// the intermediate levels
+void LimitEvaluator::fillGrid(int *grid, int quad, int first, int winding, int x, int y, int cellSize) const
+{
+    if (cellSize == 1)
+    {
+        for (int m = 0; m < 4; m++)
+            grid[(y + cornerY[m]) * (size + 1) + x + cornerX[m]] = quadCorner(local.quads[quad], first + winding * m);
+        return;
+    }
+
+    int half = cellSize / 2;
+    for (int m = 0; m < 4; m++)
+    {
+        int child = quad * 4 + ((first + winding * m) & 3);
+        int childFirst = (winding == 1) ? ((4 - m) & 3) : m;
+        fillGrid(grid, child, childFirst, winding, x + cornerX[m] * half, y + cornerY[m] * half, half);
+    }
+}
+
+void LimitEvaluator::subdivideIrregular(int levels)
+{
+    int numQuads = base.quads.count();
+    int numVertices = base.vertices.count();
+
+    // a vertex is regular if it is surrounded by a closed fan of four quads
+    QVector<char> regularVertex(numVertices, 0);
+    QVector<int> edges, diagonals;
+    for (int v = 0; v < numVertices; v++)
+        if (adjacency.valence(v) == 4 && adjacency.ring(v, adjacency.corners[adjacency.start[v]], edges, diagonals))
+            regularVertex[v] = 1;
+
+    // the limit surface over a quad only depends on the quads touching its corners
+    QVector<char> inLocal(numQuads, 0);
+    QVector<int> irregularQuads;
+    irregularIndex.fill(-1, numQuads);
+    for (int q = 0; q < numQuads; q++)
+    {
+        const Quad &quad = base.quads[q];
+        if (regularVertex[quad.a.index] && regularVertex[quad.b.index] && regularVertex[quad.c.index] && regularVertex[quad.d.index])
+            continue;
+
+        irregularIndex[q] = irregularQuads.count();
+        irregularQuads += q;
+        for (int i = 0; i < 4; i++)
+        {
+            int v = quadCorner(quad, i);
+            for (int j = adjacency.start[v]; j < adjacency.start[v + 1]; j++)
+                inLocal[adjacency.corners[j] / 4] = 1;
+        }
+    }
+    if (irregularQuads.isEmpty())
+        return;
+
+    // copy the neighborhoods, keeping the base quad order
+    QVector<int> localVertex(numVertices, -1);
+    QVector<int> localQuad(numQuads, -1);
+    for (int q = 0; q < numQuads; q++)
+    {
+        if (!inLocal[q]) continue;
+        int corners[4];
+        for (int i = 0; i < 4; i++)
+        {
+            int v = quadCorner(base.quads[q], i);
+            if (localVertex[v] == -1)
+            {
+                localVertex[v] = local.vertices.count();
+                local.vertices += Vertex(base.vertices[v].pos);
+            }
+            corners[i] = localVertex[v];
+        }
+        localQuad[q] = local.quads.count();
+        local.quads += Quad(corners[0], corners[1], corners[2], corners[3]);
+    }
+
+    for (int level = 0; level < levels; level++)
+        subdivideQuads(local);
+
+    int gridPoints = (size + 1) * (size + 1);
+    irregularGrid.resize(irregularQuads.count() * gridPoints);
+    localNeeded.fill(0, local.vertices.count());
+    for (int i = 0; i < irregularQuads.count(); i++)
+    {
+        int *grid = irregularGrid.data() + i * gridPoints;
+        fillGrid(grid, localQuad[irregularQuads[i]], 0, 1, 0, 0, size);
+        for (int j = 0; j < gridPoints; j++)
+            localNeeded[grid[j]] = 1;
+    }
+
+    localAdjacency.build(local.quads, local.vertices.count());
+    localPos.resize(local.vertices.count());
+    localNormal.resize(local.vertices.count());
+    parallelFor(local.vertices.count(), this, &LimitEvaluator::evaluateLocal, 256);
+}
+
+void LimitEvaluator::evaluateLocal(int begin, int end)
+{
+    const Vertex *vertices = local.vertices.constData();
+    QVector<int> edges, diagonals;
+    for (int v = begin; v < end; v++)
+    {
+        if (!localNeeded.at(v)) continue;
+        if (localAdjacency.valence(v) > 0 && localAdjacency.ring(v, localAdjacency.corners.at(localAdjacency.start.at(v)), edges, diagonals))
+            interiorLimit(vertices, v, edges, diagonals, localPos[v], localNormal[v]);
+        else
+            borderLimit(vertices, localAdjacency, v, localPos[v], localNormal[v]);
+    }
+}
+
+// base vertices come first, then the points inside each base edge (numbered
+// from edgeStart), then the points inside each base quad
+int LimitEvaluator::outputIndex(int face, int x, int y) const
+{
+    const Quad &quad = base.quads.at(face);
+    for (int i = 0; i < 4; i++)
+        if (x == cornerX[i] * size && y == cornerY[i] * size)
+            return quadCorner(quad, i);
+
+    int corner = -1, t = 0;
+    if (y == 0) { corner = 0; t = x; }
+    else if (x == size) { corner = 1; t = y; }
+    else if (y == size) { corner = 2; t = size - x; }
+    else if (x == 0) { corner = 3; t = size - y; }
+
+    if (corner != -1)
+    {
+        int edge = cornerEdge.at(face * 4 + corner);
+        if (quadCorner(quad, corner) != edgeStart.at(edge)) t = size - t;
+        return edgeOffset + edge * (size - 1) + t - 1;
+    }
+    return faceOffset + (face * (size - 1) + y - 1) * (size - 1) + x - 1;
+}
+
+// points shared between quads are evaluated once, by the first quad using them
+bool LimitEvaluator::owns(int face, int x, int y) const
+{
+    const Quad &quad = base.quads.at(face);
+    for (int i = 0; i < 4; i++)
+        if (x == cornerX[i] * size && y == cornerY[i] * size)
+            return adjacency.firstQuad(quadCorner(quad, i)) == face;
+
+    int corner = -1;
+    if (y == 0) corner = 0;
+    else if (x == size) corner = 1;
+    else if (y == size) corner = 2;
+    else if (x == 0) corner = 3;
+    return corner == -1 || edgeOwner.at(cornerEdge.at(face * 4 + corner)) == face;
+}
+
+void LimitEvaluator::evaluateFaces(int begin, int end)
+{
+    // where each corner of a regular quad sits in its 4x4 grid of control points
+    static const int controlX[4] = { 1, 2, 2, 1 };
+    static const int controlY[4] = { 1, 1, 2, 2 };
+
+    const Vertex *vertices = base.vertices.constData();
+    QVector<int> edges, diagonals;
+    Vector3 control[4][4];
+
+    for (int f = begin; f < end; f++)
+    {
+        const Quad &quad = base.quads.at(f);
+        int irregular = irregularIndex.at(f);
+
+        if (irregular == -1)
+        {
+            // the corner's ring, starting at this quad, covers the control
+            // points on either side of the corner
+            for (int i = 0; i < 4; i++)
+            {
+                int v = quadCorner(quad, i);
+                adjacency.ring(v, f * 4 + i, edges, diagonals);
+                int x = controlX[i], y = controlY[i];
+                int nx = controlX[(i + 1) & 3] - x, ny = controlY[(i + 1) & 3] - y;
+                int px = controlX[(i + 3) & 3] - x, py = controlY[(i + 3) & 3] - y;
+                control[x][y] = vertices[v].pos;
+                control[x + nx][y + ny] = vertices[edges[0]].pos;
+                control[x + px][y + py] = vertices[edges[1]].pos;
+                control[x - nx][y - ny] = vertices[edges[2]].pos;
+                control[x - px][y - py] = vertices[edges[3]].pos;
+                control[x + nx + px][y + ny + py] = vertices[diagonals[0]].pos;
+                control[x + px - nx][y + py - ny] = vertices[diagonals[1]].pos;
+                control[x - nx - px][y - ny - py] = vertices[diagonals[2]].pos;
+                control[x - px + nx][y - py + ny] = vertices[diagonals[3]].pos;
+            }
+        }
+
+        for (int y = 0; y <= size; y++)
+        {
+            for (int x = 0; x <= size; x++)
+            {
+                if (!owns(f, x, y)) continue;
+                Vertex &vertex = outVertices[outputIndex(f, x, y)];
+
+                if (irregular != -1)
+                {
+                    int localIndex = irregularGrid.at((irregular * (size + 1) + y) * (size + 1) + x);
+                    vertex.pos = localPos.at(localIndex);
+                    vertex.normal = localNormal.at(localIndex);
+                    continue;
+                }
+
+                // bicubic B-spline patch and its partial derivatives
+                const float *bu = basis.constData() + x * 4, *bv = basis.constData() + y * 4;
+                const float *du = derivative.constData() + x * 4, *dv = derivative.constData() + y * 4;
+                Vector3 pos, tangentU, tangentV;
+                for (int j = 0; j < 4; j++)
+                {
+                    Vector3 row, rowDerivative;
+                    for (int i = 0; i < 4; i++)
+                    {
+                        row += control[i][j] * bu[i];
+                        rowDerivative += control[i][j] * du[i];
+                    }
+                    pos += row * bv[j];
+                    tangentU += rowDerivative * bv[j];
+                    tangentV += row * dv[j];
+                }
+                vertex.pos = pos;
+                vertex.normal = tangentU.cross(tangentV).unit();
+            }
+        }
+
+        Quad *out = outQuads + f * size * size;
+        for (int y = 0; y < size; y++)
+            for (int x = 0; x < size; x++)
+                *out++ = Quad(outputIndex(f, x, y), outputIndex(f, x + 1, y), outputIndex(f, x + 1, y + 1), outputIndex(f, x, y + 1));
+    }
+}
+
+bool LimitEvaluator::build(const Mesh &cage, int levels)
+{
+    base.vertices = cage.vertices;
+    base.quads = cage.quads;
+    if (!cage.triangles.isEmpty())
+    {
+        // triangles aren't patches, but they are gone after one level
+        base.triangles = cage.triangles;
+        if (!CatmullMesh::subdivide(base))
+            return false;
+        levels = qMax(levels - 1, 0);
+    }
+
+    size = 1 << levels;
+    adjacency.build(base.quads, base.vertices.count());
+    buildEdges();
+    buildBasis();
+    subdivideIrregular(levels);
+    return true;
+}
+
+bool LimitSurface::evaluate(const Mesh &cage, int levels, Mesh &out)
+{
+    PROFILE_SCOPE("LimitSurface::evaluate");
+    LimitEvaluator evaluator;
+    if (!evaluator.build(cage, qMax(levels, 0)))
+        return false;
+
+    int size = evaluator.size;
+    int numQuads = evaluator.base.quads.count();
+    evaluator.edgeOffset = evaluator.base.vertices.count();
+    evaluator.faceOffset = evaluator.edgeOffset + evaluator.edgeStart.count() * (size - 1);
+
+    QVector<Vertex> vertices(evaluator.faceOffset + numQuads * (size - 1) * (size - 1));
+    QVector<Quad> quads(numQuads * size * size);
+    evaluator.outVertices = vertices.data();
+    evaluator.outQuads = quads.data();
+    parallelFor(numQuads, &evaluator, &LimitEvaluator::evaluateFaces, 64);
+
+    out.balls = cage.balls;
+    qSwap(out.vertices, vertices);
+    out.triangles.clear();
+    qSwap(out.quads, quads);
+    PROFILE_COUNTER("limit surface quads", out.quads.count());
+    return true;
+}
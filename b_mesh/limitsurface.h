@@ -0,0 +1,33 @@
+#ifndef LIMITSURFACE_H
+#define LIMITSURFACE_H
+
+#include "mesh.h"
+
+/**
+ * Evaluates the Catmull-Clark limit surface of a cage directly, instead of
+ * subdividing it level by level. The output has the resolution of the cage
+ * subdivided the given number of times (each cage quad becomes a 2^levels by
+ * 2^levels grid of quads), but every vertex lies on the limit surface and
+ * every normal is the exact limit surface normal, so there is no need to call
+ * Mesh::updateNormals() afterwards.
+ *
+ * Faces whose corners all have four neighboring quads are regular bicubic
+ * B-spline patches and are evaluated straight from the cage. The remaining
+ * faces (next to extraordinary vertices or borders) are subdivided locally,
+ * just their one-ring neighborhood, and pushed to the limit with the limit
+ * position and tangent masks. Border vertices keep the boundary curve limit
+ * but get the averaged face normal.
+ *
+ * Cages with triangles are subdivided once first, which uses up one level.
+ * The output vertices are laid out as the cage vertices, then the points on
+ * each cage edge, then the points inside each cage face. They carry no
+ * joint weights.
+ */
+class LimitSurface
+{
+public:
+    // returns false (and leaves out alone) if the cage can't be subdivided
+    static bool evaluate(const Mesh &cage, int levels, Mesh &out);
+};
+
+#endif // LIMITSURFACE_H
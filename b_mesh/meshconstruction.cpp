@@ -1,6 +1,7 @@
 #include "meshconstruction.h"
 #include "convexhull3d.h"
 #include "trianglestoquads.h"
+#include "profiler.h"
 #include <QHash>
 
 unsigned int qHash(const Vector3 &vec)
@@ -392,6 +393,7 @@ void sweep(Mesh &mesh, int ballIndex, ResultQuad &result)
 }
 
 void MeshConstruction::BMeshInit(Mesh &m) {
+    PROFILE_SCOPE("MeshConstruction::BMeshInit");
     ResultQuad result;
 
     //empty the mesh
@@ -1,8 +1,26 @@
 #include "meshevolution.h"
+#include "sweepgrid.h"
 #include "curvature.h"
+#include "profiler.h"
+#include "parallel.h"
+#include <QtAlgorithms>
 #include <float.h>
 #include <qgl.h>
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+// sweeps per leaf of a SweepTree, one SweepPacket
+#define SWEEP_LEAF_SIZE 4
+
+// converge() gives up on a vertex once its step is this small
+#define MIN_EVOLUTION_STEP (1.0f / 64)
+
+// relative slack in SweepTree bounds, much larger than the rounding error in
+// Sweep::scalarField() so pruning never changes the result
+#define SWEEP_BOUND_TOLERANCE 1e-4f
+
 float Sweep::project(const Vector3 &pos) const
 {
     return AtoB.dot(pos - centerA) / AtoB_lengthSquared;
@@ -25,30 +43,306 @@ float Sweep::scalarField(const Vector3 &pos) const
     return (centerA + AtoB * t - pos).length() - (radiusA + (radiusB - radiusA) * t);
 }
 
-Vector3 MeshEvolution::scalarFieldNormal(const Vector3 &pos) const
+float Sweep::scalarField(const Vector3 &pos, Vector3 &gradient) const
 {
-    const float e = 1e-2;
-    Vector3 dx(e, 0, 0);
-    Vector3 dy(0, e, 0);
-    Vector3 dz(0, 0, e);
+    gradient = Vector3();
+    if (onlyUseA)
+    {
+        Vector3 offset = pos - centerA;
+        float length = offset.length();
+        if (length > 0) gradient = offset / length;
+        return length - radiusA;
+    }
 
-    Vector3 normal(
-            scalarField(pos + dx) - scalarField(pos - dx),
-            scalarField(pos + dy) - scalarField(pos - dy),
-            scalarField(pos + dz) - scalarField(pos - dz)
-    );
+    // the same steps as above, keeping track of how t moves with pos:
+    // t = project(pos) + (radiusB - radiusA) * distance to the axis / |AtoB|^2
+    Vector3 closest = centerA + AtoB * project(pos);
+    float axisDistance = (closest - pos).length();
+    Vector3 tilted = closest + AtoB * ((radiusB - radiusA) * axisDistance / AtoB_lengthSquared);
+    float unclamped = project(tilted);
+    float t = max(0, min(1, unclamped));
+    Vector3 offset = pos - (centerA + AtoB * t);
+    float length = offset.length();
+    float value = length - (radiusA + (radiusB - radiusA) * t);
+    if (length == 0) return value;
 
-    float len = normal.length();
-    if (len < 1e-6) {
-        return Vector3();
+    // d/dpos of |pos - (A + AtoB t)| - (radiusA + (radiusB - radiusA) t)
+    gradient = offset / length;
+    if (unclamped > 0 && unclamped < 1)
+    {
+        Vector3 dt = AtoB / AtoB_lengthSquared;
+        if (axisDistance > 0) dt += (pos - closest) * ((radiusB - radiusA) / (AtoB_lengthSquared * axisDistance));
+        gradient -= dt * (AtoB.dot(gradient) + radiusB - radiusA);
     }
+    return value;
+}
+
+// orders sweeps by the center of their box along one axis
+struct SweepCenterLessThan
+{
+    const QVector<Vector3> &centers;
+    int axis;
 
-    return normal / len;
+    SweepCenterLessThan(const QVector<Vector3> &centers, int axis) : centers(centers), axis(axis) {}
+    bool operator () (int a, int b) const { return centers[a].xyz[axis] < centers[b].xyz[axis]; }
+};
+
+static float largestMagnitude(const Vector3 &v)
+{
+    return max(fabsf(v.x), max(fabsf(v.y), fabsf(v.z)));
+}
+
+void SweepTree::build(const QVector<Sweep> &input)
+{
+    sweeps.clear();
+    nodes.clear();
+    packets.clear();
+    inputIndices.clear();
+    if (input.isEmpty()) return;
+
+    QVector<int> order(input.count());
+    for (int i = 0; i < order.count(); i++)
+        order[i] = i;
+    buildNode(order, 0, order.count(), input);
+
+    sweeps.reserve(input.count());
+    foreach (int i, order)
+        sweeps += input[i];
+    inputIndices = order;
 }
 
-void MeshEvolution::drawDebug(Mesh &mesh, float gridMin, float gridMax, int divisions)
+int SweepTree::buildNode(QVector<int> &order, int first, int count, const QVector<Sweep> &input)
 {
-    MeshEvolution evo(mesh);
+    Node node;
+    QVector<Vector3> centers(count);
+    input[order[first]].getBounds(node.minCorner, node.maxCorner, node.radius);
+    for (int i = 0; i < count; i++)
+    {
+        Vector3 minCorner, maxCorner;
+        float radius;
+        input[order[first + i]].getBounds(minCorner, maxCorner, radius);
+        node.minCorner = Vector3::min(node.minCorner, minCorner);
+        node.maxCorner = Vector3::max(node.maxCorner, maxCorner);
+        node.radius = max(node.radius, radius);
+        centers[i] = (minCorner + maxCorner) / 2;
+    }
+    node.tolerance = SWEEP_BOUND_TOLERANCE * (1 + max(largestMagnitude(node.minCorner), largestMagnitude(node.maxCorner)) + node.radius);
+    node.left = node.right = -1;
+    node.first = first;
+    node.count = count;
+    node.packet = -1;
+
+    int index = nodes.count();
+    nodes += node;
+    if (count <= SWEEP_LEAF_SIZE)
+    {
+        SweepPacket packet;
+        for (int lane = 0; lane < 4; lane++)
+        {
+            const Sweep &sweep = input[order[first + qMin(lane, count - 1)]];
+            for (int i = 0; i < 3; i++)
+            {
+                packet.centerA[i][lane] = sweep.centerA.xyz[i];
+                packet.AtoB[i][lane] = sweep.onlyUseA ? 0 : sweep.AtoB.xyz[i];
+            }
+            packet.radiusA[lane] = sweep.radiusA;
+            packet.radiusB[lane] = sweep.onlyUseA ? sweep.radiusA : sweep.radiusB;
+            packet.AtoB_lengthSquared[lane] = sweep.onlyUseA ? 1 : sweep.AtoB_lengthSquared;
+        }
+        nodes[index].packet = packets.count();
+        packets += packet;
+        return index;
+    }
+
+    // split at the median center along the longest axis
+    Vector3 minCenter = centers[0], maxCenter = centers[0];
+    foreach (const Vector3 &center, centers)
+    {
+        minCenter = Vector3::min(minCenter, center);
+        maxCenter = Vector3::max(maxCenter, center);
+    }
+    Vector3 size = maxCenter - minCenter;
+    int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z) ? 1 : 2;
+
+    QVector<int> local(count);
+    for (int i = 0; i < count; i++)
+        local[i] = i;
+    qSort(local.begin(), local.end(), SweepCenterLessThan(centers, axis));
+    QVector<int> sorted(count);
+    for (int i = 0; i < count; i++)
+        sorted[i] = order[first + local[i]];
+    for (int i = 0; i < count; i++)
+        order[first + i] = sorted[i];
+
+    int half = count / 2;
+    int left = buildNode(order, first, half, input);
+    int right = buildNode(order, first + half, count - half, input);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+}
+
+float SweepTree::lowerBound(const Node &node, const Vector3 &pos)
+{
+    Vector3 nearest = Vector3::min(Vector3::max(pos, node.minCorner), node.maxCorner);
+    return (nearest - pos).length() - node.radius - node.tolerance * (1 + largestMagnitude(pos));
+}
+
+float SweepTree::minimum(const Vector3 &pos) const
+{
+    float best = FLT_MAX;
+    if (nodes.isEmpty()) return best;
+
+    // nearer children are visited first so the bound drops quickly
+    int stack[64];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0)
+    {
+        const Node &node = nodes[stack[--size]];
+        if (lowerBound(node, pos) > best) continue;
+
+        if (node.left == -1)
+        {
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                float curr = sweeps[i].scalarField(pos);
+                if (curr < best) best = curr;
+            }
+            continue;
+        }
+
+        bool leftFirst = lowerBound(nodes[node.left], pos) <= lowerBound(nodes[node.right], pos);
+        stack[size++] = leftFirst ? node.right : node.left;
+        stack[size++] = leftFirst ? node.left : node.right;
+    }
+    return best;
+}
+
+#ifdef __SSE__
+// Sweep::scalarField(pos, gradient) for four sweeps at once, step by step
+static void evaluatePacket(const float *centerA, const float *AtoB, const float *radiusA, const float *radiusB,
+    const float *lengthSquared, const Vector3 &pos, float *values, float *gradients)
+{
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+    __m128 px = _mm_set1_ps(pos.x), py = _mm_set1_ps(pos.y), pz = _mm_set1_ps(pos.z);
+    __m128 ax = _mm_loadu_ps(centerA), ay = _mm_loadu_ps(centerA + 4), az = _mm_loadu_ps(centerA + 8);
+    __m128 bx = _mm_loadu_ps(AtoB), by = _mm_loadu_ps(AtoB + 4), bz = _mm_loadu_ps(AtoB + 8);
+    __m128 rA = _mm_loadu_ps(radiusA), rB = _mm_loadu_ps(radiusB), l2 = _mm_loadu_ps(lengthSquared);
+    __m128 dr = _mm_sub_ps(rB, rA);
+
+    // closest = centerA + AtoB * project(pos)
+    __m128 project = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(bx, _mm_sub_ps(px, ax)),
+        _mm_mul_ps(by, _mm_sub_ps(py, ay))), _mm_mul_ps(bz, _mm_sub_ps(pz, az))), l2);
+    __m128 cx = _mm_add_ps(ax, _mm_mul_ps(bx, project));
+    __m128 cy = _mm_add_ps(ay, _mm_mul_ps(by, project));
+    __m128 cz = _mm_add_ps(az, _mm_mul_ps(bz, project));
+    __m128 ox = _mm_sub_ps(cx, px), oy = _mm_sub_ps(cy, py), oz = _mm_sub_ps(cz, pz);
+    __m128 axisDistance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)));
+
+    // t = max(0, min(1, project(tilted)))
+    __m128 tilt = _mm_div_ps(_mm_mul_ps(dr, axisDistance), l2);
+    __m128 tx = _mm_add_ps(cx, _mm_mul_ps(bx, tilt));
+    __m128 ty = _mm_add_ps(cy, _mm_mul_ps(by, tilt));
+    __m128 tz = _mm_add_ps(cz, _mm_mul_ps(bz, tilt));
+    __m128 unclamped = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(bx, _mm_sub_ps(tx, ax)),
+        _mm_mul_ps(by, _mm_sub_ps(ty, ay))), _mm_mul_ps(bz, _mm_sub_ps(tz, az))), l2);
+    __m128 t = _mm_max_ps(zero, _mm_min_ps(one, unclamped));
+
+    __m128 offx = _mm_sub_ps(px, _mm_add_ps(ax, _mm_mul_ps(bx, t)));
+    __m128 offy = _mm_sub_ps(py, _mm_add_ps(ay, _mm_mul_ps(by, t)));
+    __m128 offz = _mm_sub_ps(pz, _mm_add_ps(az, _mm_mul_ps(bz, t)));
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(offx, offx), _mm_mul_ps(offy, offy)), _mm_mul_ps(offz, offz)));
+    _mm_storeu_ps(values, _mm_sub_ps(length, _mm_add_ps(rA, _mm_mul_ps(dr, t))));
+
+    // the t term of the gradient, only where t isn't clamped
+    __m128 gx = _mm_div_ps(offx, length), gy = _mm_div_ps(offy, length), gz = _mm_div_ps(offz, length);
+    __m128 scale = _mm_div_ps(dr, _mm_mul_ps(l2, axisDistance));
+    __m128 offAxis = _mm_cmpgt_ps(axisDistance, zero);
+    __m128 dtx = _mm_div_ps(bx, l2), dty = _mm_div_ps(by, l2), dtz = _mm_div_ps(bz, l2);
+    dtx = _mm_or_ps(_mm_and_ps(offAxis, _mm_add_ps(dtx, _mm_mul_ps(_mm_sub_ps(px, cx), scale))), _mm_andnot_ps(offAxis, dtx));
+    dty = _mm_or_ps(_mm_and_ps(offAxis, _mm_add_ps(dty, _mm_mul_ps(_mm_sub_ps(py, cy), scale))), _mm_andnot_ps(offAxis, dty));
+    dtz = _mm_or_ps(_mm_and_ps(offAxis, _mm_add_ps(dtz, _mm_mul_ps(_mm_sub_ps(pz, cz), scale))), _mm_andnot_ps(offAxis, dtz));
+    __m128 slope = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(bx, gx), _mm_mul_ps(by, gy)), _mm_mul_ps(bz, gz)), rB), rA);
+    __m128 inside = _mm_and_ps(_mm_cmpgt_ps(unclamped, zero), _mm_cmplt_ps(unclamped, one));
+    gx = _mm_or_ps(_mm_and_ps(inside, _mm_sub_ps(gx, _mm_mul_ps(dtx, slope))), _mm_andnot_ps(inside, gx));
+    gy = _mm_or_ps(_mm_and_ps(inside, _mm_sub_ps(gy, _mm_mul_ps(dty, slope))), _mm_andnot_ps(inside, gy));
+    gz = _mm_or_ps(_mm_and_ps(inside, _mm_sub_ps(gz, _mm_mul_ps(dtz, slope))), _mm_andnot_ps(inside, gz));
+
+    // no gradient at the center of a sweep
+    __m128 nonzero = _mm_cmpneq_ps(length, zero);
+    _mm_storeu_ps(gradients, _mm_and_ps(nonzero, gx));
+    _mm_storeu_ps(gradients + 4, _mm_and_ps(nonzero, gy));
+    _mm_storeu_ps(gradients + 8, _mm_and_ps(nonzero, gz));
+}
+#endif
+
+float SweepTree::minimum(const Vector3 &pos, Vector3 &gradient) const
+{
+    float best = FLT_MAX;
+    int bestIndex = -1;
+    gradient = Vector3();
+    if (nodes.isEmpty()) return best;
+
+    // the same traversal as above
+    int stack[64];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0)
+    {
+        const Node &node = nodes[stack[--size]];
+        if (lowerBound(node, pos) > best) continue;
+
+        if (node.left == -1)
+        {
+#ifdef __SSE__
+            const SweepPacket &packet = packets[node.packet];
+            float values[4], gradients[12];
+            evaluatePacket(packet.centerA[0], packet.AtoB[0], packet.radiusA, packet.radiusB,
+                packet.AtoB_lengthSquared, pos, values, gradients);
+            for (int lane = 0; lane < node.count; lane++)
+            {
+                int index = inputIndices[node.first + lane];
+                if (values[lane] < best || (values[lane] == best && index < bestIndex))
+                {
+                    best = values[lane];
+                    bestIndex = index;
+                    gradient = Vector3(gradients[lane], gradients[lane + 4], gradients[lane + 8]);
+                }
+            }
+#else
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                Vector3 currGradient;
+                float curr = sweeps[i].scalarField(pos, currGradient);
+                if (curr < best || (curr == best && inputIndices[i] < bestIndex))
+                {
+                    best = curr;
+                    bestIndex = inputIndices[i];
+                    gradient = currGradient;
+                }
+            }
+#endif
+            continue;
+        }
+
+        bool leftFirst = lowerBound(nodes[node.left], pos) <= lowerBound(nodes[node.right], pos);
+        stack[size++] = leftFirst ? node.right : node.left;
+        stack[size++] = leftFirst ? node.left : node.right;
+    }
+    return best;
+}
+
+Vector3 MeshEvolution::scalarFieldNormal(const Vector3 &pos) const
+{
+    Vector3 normal;
+    scalarField(pos, normal);
+    return normal;
+}
+
+void MeshEvolution::drawDebug(Mesh &mesh, float gridMin, float gridMax, int divisions, const SweepGrid *grid)
+{
+    MeshEvolution evo(mesh, grid);
 
     float x, y, z;
     float increment = (gridMax - gridMin) / divisions;
@@ -75,8 +369,10 @@ void MeshEvolution::drawDebug(Mesh &mesh, float gridMin, float gridMax, int divi
 }
 
 
-MeshEvolution::MeshEvolution(Mesh &mesh) : mesh(mesh)
+MeshEvolution::MeshEvolution(Mesh &mesh, const SweepGrid *grid) : mesh(mesh), grid(grid)
 {
+    if (grid) return;
+
     // generate in-between balls using hax
     foreach (const Ball &ball, mesh.balls)
     {
@@ -88,37 +384,112 @@ MeshEvolution::MeshEvolution(Mesh &mesh) : mesh(mesh)
             sweeps += Sweep(ball, parent);
         }
     }
+    tree.build(sweeps);
 }
 
 float MeshEvolution::scalarField(const Vector3 &pos) const
 {
-    float minPos = FLT_MAX, minNeg = 0;
-    foreach (const Sweep &sweep, sweeps) {
-        float curr = sweep.scalarField(pos);
-        if (curr < 0) {
-            minNeg = min(minNeg, curr);
-        } else {
-            minPos = min(minPos, curr);
-        }
+    // the most negative sweep if inside any, otherwise the closest one,
+    // which is the smallest value either way
+    return grid ? grid->scalarField(pos) : tree.minimum(pos);
+}
+
+// the field and its unit normal (zero where there is no gradient) in one pass,
+// the gradient of the smallest sweep is the gradient of the field
+float MeshEvolution::scalarField(const Vector3 &pos, Vector3 &normal) const
+{
+    float value = grid ? grid->scalarField(pos, normal) : tree.minimum(pos, normal);
+    float len = normal.length();
+    normal = (len < 1e-6) ? Vector3() : normal / len;
+    return value;
+}
+
+void MeshEvolution::evolveVertices(int begin, int end)
+{
+    for (int i = begin; i < end; ++i) {
+        Vertex &vertex = vertices[i];
+        Vector3 normal;
+        float value = scalarField(vertex.pos, normal);
+        vertex.pos -= normal * value;
     }
+}
+
+void MeshEvolution::evolve()
+{
+    // detach once here, not from every thread
+    vertices = mesh.vertices.data();
+    parallelFor(mesh.vertices.count(), this, &MeshEvolution::evolveVertices, 256);
+    mesh.updateNormals();
+}
+
+void MeshEvolution::convergeVertices(int begin, int end)
+{
+    for (int i = begin; i < end; ++i) {
+        int index = active[i];
+        Vertex &vertex = vertices[index];
+        Vector3 normal;
+        float value = scalarField(vertex.pos, normal);
+        float residual = fabsf(value);
+        if (residual <= tolerance || normal == Vector3()) {
+            steps[index] = 0;
+            continue;
+        }
 
-    if (minNeg == 0) {
-        return minPos;
+        // damp vertices that got worse (usually bouncing across a crease
+        // between two sweeps) and let the rest speed back up
+        if (residual > residuals[index]) steps[index] *= 0.5f;
+        else steps[index] = min(1, steps[index] * 2);
+        residuals[index] = residual;
+        vertex.pos -= normal * (value * steps[index]);
     }
-    return minNeg;
 }
 
-void MeshEvolution::evolve() const
+int MeshEvolution::converge(int maxIterations)
 {
-    for (int i = 0; i < mesh.vertices.count(); ++i) {
-        Vertex &vertex = mesh.vertices[i];
-        vertex.pos -= scalarFieldNormal(vertex.pos) * scalarField(vertex.pos);
+    int count = mesh.vertices.count();
+    vertices = mesh.vertices.data();
+    residuals.fill(FLT_MAX, count);
+    steps.fill(1, count);
+    active.resize(count);
+    for (int i = 0; i < count; i++)
+        active[i] = i;
+
+    int iterations = 0;
+    while (!active.isEmpty() && iterations < maxIterations) {
+        parallelFor(active.count(), this, &MeshEvolution::convergeVertices, 256);
+        iterations++;
+
+        // drop the vertices that converged or stalled
+        int kept = 0;
+        for (int i = 0; i < active.count(); i++) {
+            if (steps[active[i]] >= MIN_EVOLUTION_STEP)
+                active[kept++] = active[i];
+        }
+        active.resize(kept);
     }
+
+    PROFILE_COUNTER("unconverged vertices", active.count());
     mesh.updateNormals();
+    return iterations;
 }
 
-void MeshEvolution::run(Mesh &mesh)
+void MeshEvolution::run(Mesh &mesh, const SweepGrid *grid)
 {
-    MeshEvolution evolution(mesh);
+    PROFILE_SCOPE("MeshEvolution::run");
+    MeshEvolution evolution(mesh, grid);
     evolution.evolve();
 }
+
+int MeshEvolution::runToConvergence(Mesh &mesh, float tolerance, int maxIterations, const SweepGrid *grid)
+{
+    PROFILE_SCOPE("MeshEvolution::runToConvergence");
+    MeshEvolution evolution(mesh, grid);
+    if (tolerance <= 0 && !mesh.balls.isEmpty()) {
+        float smallest = FLT_MAX;
+        foreach (const Ball &ball, mesh.balls)
+            smallest = min(smallest, ball.maxRadius());
+        tolerance = smallest / 1000;
+    }
+    evolution.tolerance = tolerance;
+    return evolution.converge(maxIterations);
+}
@@ -3,6 +3,8 @@
 
 #include "mesh.h"
 
+class SweepGrid;
+
 /**
  * Defines a signed distance field around a sphere swept from one sphere to another.
  */
@@ -19,6 +21,8 @@ private:
     float AtoB_lengthSquared;
     bool onlyUseA;
 
+    friend class SweepTree;
+
 public:
     Sweep() {}
     Sweep(const Ball &ballA, const Ball &ballB) :
@@ -41,7 +45,83 @@ public:
         }
     }
 
+    bool operator == (const Sweep &other) const
+    {
+        return centerA == other.centerA && centerB == other.centerB && radiusA == other.radiusA &&
+            radiusB == other.radiusB && onlyUseA == other.onlyUseA;
+    }
+
     float scalarField(const Vector3 &pos) const;
+
+    // the same value as scalarField(pos) along with its gradient, which is
+    // zero where the field isn't differentiable
+    float scalarField(const Vector3 &pos, Vector3 &gradient) const;
+
+    // scalarField() is never less than the distance to the box around the
+    // segment between the centers minus radius
+    void getBounds(Vector3 &minCorner, Vector3 &maxCorner, float &radius) const
+    {
+        minCorner = onlyUseA ? centerA : Vector3::min(centerA, centerB);
+        maxCorner = onlyUseA ? centerA : Vector3::max(centerA, centerB);
+        radius = onlyUseA ? radiusA : max(radiusA, radiusB);
+    }
+};
+
+/**
+ * A bounding volume hierarchy over sweeps for finding the smallest sweep value
+ * at a point without evaluating every sweep. Each node knows a lower bound for
+ * every sweep below it (see Sweep::getBounds()), so nodes that can't beat the
+ * smallest value found so far are skipped. The result is exactly the minimum
+ * over all sweeps, and ties go to the sweep that comes first in the input, so
+ * the gradient is also the one a plain loop over the sweeps would pick.
+ *
+ * Leaves hold up to four sweeps, which are also stored struct-of-arrays so
+ * SSE evaluates a whole leaf at once. The vector path does the same float
+ * operations in the same order as Sweep::scalarField(), so it gives the same
+ * results as the scalar path (which is used when SSE isn't available).
+ */
+class SweepTree
+{
+private:
+    struct Node
+    {
+        Vector3 minCorner;
+        Vector3 maxCorner;
+        float radius;
+        float tolerance; // covers float rounding in the bound
+        int left, right; // children, -1 for leaves
+        int first, count; // the sweeps of a leaf
+        int packet; // the same sweeps in packets
+    };
+
+    // the sweeps of one leaf, one per lane. Sweeps that only use A have AtoB
+    // set to zero, which makes the general formula reduce to the sphere around A,
+    // and unused lanes repeat the last sweep
+    struct SweepPacket
+    {
+        float centerA[3][4];
+        float AtoB[3][4];
+        float radiusA[4];
+        float radiusB[4];
+        float AtoB_lengthSquared[4];
+    };
+
+    QVector<Sweep> sweeps; // reordered so leaves are contiguous
+    QVector<int> inputIndices; // the input position of each sweep, for breaking ties
+    QVector<Node> nodes;
+    QVector<SweepPacket> packets;
+
+    int buildNode(QVector<int> &order, int first, int count, const QVector<Sweep> &input);
+    static float lowerBound(const Node &node, const Vector3 &pos);
+
+public:
+    void build(const QVector<Sweep> &input);
+
+    // the smallest scalarField() of all sweeps, FLT_MAX if there are none
+    float minimum(const Vector3 &pos) const;
+
+    // also returns the gradient of the sweep with the smallest value
+    float minimum(const Vector3 &pos, Vector3 &gradient) const;
 };
 
 class MeshEvolution
@@ -51,16 +131,41 @@ private:
 
     Mesh &mesh;
     QVector<Sweep> sweeps;
+    SweepTree tree;
+    const SweepGrid *grid; // replaces tree when set
 
-    MeshEvolution(Mesh &mesh);
+    MeshEvolution(Mesh &mesh, const SweepGrid *grid);
 
     float scalarField(const Vector3 &pos) const;
+    float scalarField(const Vector3 &pos, Vector3 &normal) const;
     Vector3 scalarFieldNormal(const Vector3 &pos) const;
-    void evolve() const;
+    void evolve();
+
+    // moves vertices [begin, end), split over the thread pool by evolve()
+    Vertex *vertices;
+    void evolveVertices(int begin, int end);
+
+    // per-vertex state of converge(), indexed by vertex
+    QVector<int> active; // vertices still moving
+    QVector<float> residuals; // |field| before the last step
+    QVector<float> steps; // fraction of the projection to take
+    float tolerance;
+    int converge(int maxIterations);
+    void convergeVertices(int begin, int end);
 
 public:
-    static void run(Mesh &mesh);
-    static void drawDebug(Mesh &mesh, float min, float max, int increments);
+    // one projection of every vertex onto the surface. A grid (which must be
+    // up to date with mesh.balls) makes field lookups interpolated and cached
+    static void run(Mesh &mesh, const SweepGrid *grid = NULL);
+
+    // projects repeatedly until every vertex is within tolerance of the surface
+    // (0 picks a thousandth of the smallest ball radius) or maxIterations is hit.
+    // Vertices stop being evaluated once they converge, and a vertex whose step
+    // made things worse takes half the step next time (it grows back as things
+    // improve). Returns the number of iterations.
+    static int runToConvergence(Mesh &mesh, float tolerance = 0, int maxIterations = 50, const SweepGrid *grid = NULL);
+
+    static void drawDebug(Mesh &mesh, float min, float max, int increments, const SweepGrid *grid = NULL);
 };
 
 #endif // MESHEVOLUTION_H
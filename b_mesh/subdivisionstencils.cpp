@@ -0,0 +1,188 @@
+#include "subdivisionstencils.h"
+#include "catmullclark.h"
+#include "parallel.h"
+#include "profiler.h"
+#include <QtAlgorithms>
+
+// one row of the stencil table per subdivided vertex, split over the thread pool
+struct StencilProduct
+{
+    const int *offsets;
+    const int *indices;
+    const float *weights;
+    const Vertex *cage;
+    Vertex *vertices;
+
+    void run(int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            Vector3 pos;
+            for (int j = offsets[i]; j < offsets[i + 1]; j++)
+                pos += cage[indices[j]].pos * weights[j];
+            vertices[i].pos = pos;
+        }
+    }
+};
+
+// result = step * previous, where the rows of step refer to the rows of previous,
+// duplicate entries are merged and entries that cancel out are dropped
+static void multiplyStencils(const QVector<int> &stepOffsets, const QVector<int> &stepIndices, const QVector<float> &stepWeights,
+    const QVector<int> &offsets, const QVector<int> &indices, const QVector<float> &weights, int numCageVertices,
+    QVector<int> &resultOffsets, QVector<int> &resultIndices, QVector<float> &resultWeights)
+{
+    int numRows = stepOffsets.count() - 1;
+    QVector<float> sum(numCageVertices, 0);
+    QVector<int> lastRow(numCageVertices, -1);
+    QVector<int> touched;
+    touched.reserve(256);
+
+    resultOffsets.resize(numRows + 1);
+    resultIndices.clear();
+    resultWeights.clear();
+    resultIndices.reserve(stepIndices.count() * 2);
+    resultWeights.reserve(stepIndices.count() * 2);
+
+    for (int row = 0; row < numRows; row++)
+    {
+        resultOffsets[row] = resultIndices.count();
+        touched.resize(0);
+
+        for (int i = stepOffsets[row]; i < stepOffsets[row + 1]; i++)
+        {
+            int previous = stepIndices[i];
+            float weight = stepWeights[i];
+            for (int j = offsets[previous]; j < offsets[previous + 1]; j++)
+            {
+                int cage = indices[j];
+                if (lastRow[cage] != row)
+                {
+                    lastRow[cage] = row;
+                    sum[cage] = 0;
+                    touched += cage;
+                }
+                sum[cage] += weight * weights[j];
+            }
+        }
+
+        // sorted rows read the cage in order
+        qSort(touched.begin(), touched.end());
+        foreach (int cage, touched)
+        {
+            if (sum[cage] == 0) continue;
+            resultIndices += cage;
+            resultWeights += sum[cage];
+        }
+    }
+    resultOffsets[numRows] = resultIndices.count();
+}
+
+SubdivisionStencils::SubdivisionStencils() : numCageVertices(0)
+{
+}
+
+void SubdivisionStencils::clear()
+{
+    numCageVertices = 0;
+    cageTriangles.clear();
+    cageQuads.clear();
+    subdivided = Mesh();
+    offsets.clear();
+    indices.clear();
+    weights.clear();
+}
+
+bool SubdivisionStencils::build(const Mesh &cage, int levels)
+{
+    PROFILE_SCOPE("SubdivisionStencils::build");
+    clear();
+
+    Mesh mesh;
+    mesh.vertices = cage.vertices;
+    mesh.triangles = cage.triangles;
+    mesh.quads = cage.quads;
+    int n = cage.vertices.count();
+
+    // start from the identity, each level multiplies in one more subdivision step
+    QVector<int> currentOffsets(n + 1), currentIndices(n);
+    QVector<float> currentWeights(n, 1);
+    for (int i = 0; i < n; i++)
+    {
+        currentOffsets[i] = i;
+        currentIndices[i] = i;
+    }
+    currentOffsets[n] = n;
+
+    QVector<int> stepOffsets, stepIndices, nextOffsets, nextIndices;
+    QVector<float> stepWeights, nextWeights;
+    for (int level = 0; level < levels; level++)
+    {
+        CatmullMesh step(mesh);
+        if (!step.isValid())
+            return false;
+        step.getStencils(stepOffsets, stepIndices, stepWeights);
+        multiplyStencils(stepOffsets, stepIndices, stepWeights, currentOffsets, currentIndices, currentWeights, n,
+            nextOffsets, nextIndices, nextWeights);
+        qSwap(currentOffsets, nextOffsets);
+        qSwap(currentIndices, nextIndices);
+        qSwap(currentWeights, nextWeights);
+
+        // the next level needs this level's faces
+        if (!CatmullMesh::subdivide(mesh))
+            return false;
+    }
+
+    numCageVertices = n;
+    cageTriangles = cage.triangles;
+    cageQuads = cage.quads;
+    subdivided = mesh;
+    offsets = currentOffsets;
+    indices = currentIndices;
+    weights = currentWeights;
+    PROFILE_COUNTER("stencil entries", indices.count());
+    return true;
+}
+
+bool SubdivisionStencils::matches(const Mesh &cage) const
+{
+    if (isEmpty() || cage.vertices.count() != numCageVertices || cage.triangles.count() != cageTriangles.count() || cage.quads.count() != cageQuads.count())
+        return false;
+
+    for (int i = 0; i < cageTriangles.count(); i++)
+    {
+        const Triangle &a = cage.triangles[i], &b = cageTriangles[i];
+        if (a.a.index != b.a.index || a.b.index != b.b.index || a.c.index != b.c.index)
+            return false;
+    }
+    for (int i = 0; i < cageQuads.count(); i++)
+    {
+        const Quad &a = cage.quads[i], &b = cageQuads[i];
+        if (a.a.index != b.a.index || a.b.index != b.b.index || a.c.index != b.c.index || a.d.index != b.d.index)
+            return false;
+    }
+    return true;
+}
+
+void SubdivisionStencils::apply(const QVector<Vertex> &cage, QVector<Vertex> &vertices) const
+{
+    PROFILE_SCOPE("SubdivisionStencils::apply");
+    StencilProduct product;
+    product.offsets = offsets.constData();
+    product.indices = indices.constData();
+    product.weights = weights.constData();
+    product.cage = cage.constData();
+    product.vertices = vertices.data();
+    parallelFor(vertexCount(), &product, &StencilProduct::run);
+}
+
+void SubdivisionStencils::apply(const Mesh &cage, Mesh &out) const
+{
+    // copy the cage positions first in case cage and out are the same mesh
+    QVector<Vertex> cageVertices = cage.vertices;
+    out.balls = cage.balls;
+    out.vertices = subdivided.vertices;
+    out.triangles = subdivided.triangles;
+    out.quads = subdivided.quads;
+    apply(cageVertices, out.vertices);
+    out.updateNormals();
+}
@@ -0,0 +1,55 @@
+#ifndef SUBDIVISIONSTENCILS_H
+#define SUBDIVISIONSTENCILS_H
+
+#include "mesh.h"
+
+/**
+ * Catmull-Clark subdivision of a fixed cage, precomputed as a sparse matrix.
+ * Each subdivided vertex is stored as a list of (cage vertex, weight) pairs,
+ * so after the cage vertices move (sculpting or posing) the subdivided mesh
+ * is one sparse matrix-vector product away instead of a full subdivide():
+ *
+ *     SubdivisionStencils stencils;
+ *     stencils.build(cage, 3); // once per cage topology
+ *     ...
+ *     stencils.apply(cage, mesh); // every time the cage moves
+ *
+ * Positions match repeated CatmullMesh::subdivide() up to float rounding.
+ */
+class SubdivisionStencils
+{
+private:
+    int numCageVertices;
+    QVector<Triangle> cageTriangles;
+    QVector<Quad> cageQuads;
+    Mesh subdivided; // the subdivided faces and the joint weights of its vertices
+
+    // vertex i of the subdivided mesh is the sum of weights[j] * cage[indices[j]]
+    // for j from offsets[i] to offsets[i + 1] - 1, indices are sorted in each row
+    QVector<int> offsets;
+    QVector<int> indices;
+    QVector<float> weights;
+
+public:
+    SubdivisionStencils();
+
+    // returns false and stays empty if the cage can't be subdivided
+    bool build(const Mesh &cage, int levels);
+    void clear();
+
+    bool isEmpty() const { return offsets.isEmpty(); }
+    int cageVertexCount() const { return numCageVertices; }
+    int vertexCount() const { return offsets.isEmpty() ? 0 : offsets.count() - 1; }
+    int entryCount() const { return indices.count(); }
+
+    // true if cage has the vertex count and faces build() was given
+    bool matches(const Mesh &cage) const;
+
+    // sets the first vertexCount() positions in vertices from the cage positions
+    void apply(const QVector<Vertex> &cage, QVector<Vertex> &vertices) const;
+
+    // replaces out with the subdivided cage, including normals, like CatmullMesh::subdivide()
+    void apply(const Mesh &cage, Mesh &out) const;
+};
+
+#endif // SUBDIVISIONSTENCILS_H
@@ -0,0 +1,268 @@
+#include "sweepgrid.h"
+#include "profiler.h"
+#include "parallel.h"
+#include <float.h>
+#include <math.h>
+
+// cells along each side of a brick
+#define BRICK_CELLS 8
+#define BRICK_SAMPLES ((BRICK_CELLS + 1) * (BRICK_CELLS + 1) * (BRICK_CELLS + 1))
+
+// half the width of the band around the surface, in cells
+#define GRID_BAND_CELLS 3
+
+// cells are made coarser until the boxes around the sweeps need at most this
+// many bricks, which keeps models with a few tiny balls from blowing up
+#define GRID_MAX_BOX_BRICKS 65536
+
+// bricks are packed into 21 bits per axis
+#define BRICK_COORD_LIMIT (1 << 20)
+
+static qint64 brickKey(int x, int y, int z)
+{
+    return ((qint64)(x + BRICK_COORD_LIMIT) << 42) | ((qint64)(y + BRICK_COORD_LIMIT) << 21) | (qint64)(z + BRICK_COORD_LIMIT);
+}
+
+static int sampleIndex(int x, int y, int z)
+{
+    return x + (BRICK_CELLS + 1) * (y + (BRICK_CELLS + 1) * z);
+}
+
+SweepGrid::SweepGrid() : cellSize(0), band(0), sampleData(NULL), cellsPerRadius(8)
+{
+}
+
+void SweepGrid::clearBricks()
+{
+    brickIndices.clear();
+    brickOrigins.clear();
+    samples.clear();
+    freeBricks.clear();
+}
+
+void SweepGrid::clear()
+{
+    sweeps.clear();
+    tree.build(sweeps);
+    clearBricks();
+    cellSize = band = 0;
+}
+
+static void brickRange(const Sweep &sweep, float brickSize, float band, int lo[3], int hi[3])
+{
+    Vector3 minCorner, maxCorner;
+    float radius;
+    sweep.getBounds(minCorner, maxCorner, radius);
+    float reach = radius + band;
+    for (int i = 0; i < 3; i++)
+    {
+        lo[i] = (int)floorf(max(-BRICK_COORD_LIMIT, (minCorner.xyz[i] - reach) / brickSize));
+        hi[i] = (int)floorf(min(BRICK_COORD_LIMIT - 1, (maxCorner.xyz[i] + reach) / brickSize));
+    }
+}
+
+// Queues the bricks that could hold a sample whose value depends on the sweep
+// (anything not entirely outside it), allocating the missing ones that could
+// touch its band when allocate is set. The sweep field isn't an exact distance,
+// so the tests use twice the distance to the corners of the brick.
+void SweepGrid::queueRegion(const Sweep &sweep, bool allocate, QVector<char> &queued)
+{
+    float brickSize = cellSize * BRICK_CELLS;
+    float margin = 2 * sqrtf(3.0f) * brickSize / 2;
+    int lo[3], hi[3];
+    brickRange(sweep, brickSize, band, lo, hi);
+
+    for (int z = lo[2]; z <= hi[2]; z++)
+    {
+        for (int y = lo[1]; y <= hi[1]; y++)
+        {
+            for (int x = lo[0]; x <= hi[0]; x++)
+            {
+                float value = sweep.scalarField(Vector3(x + 0.5f, y + 0.5f, z + 0.5f) * brickSize);
+                if (value > band + margin) continue;
+
+                qint64 key = brickKey(x, y, z);
+                QHash<qint64, int>::const_iterator found = brickIndices.constFind(key);
+                int index;
+                if (found != brickIndices.constEnd()) index = found.value();
+                else if (!allocate || value < -band - margin) continue;
+                else
+                {
+                    if (!freeBricks.isEmpty())
+                    {
+                        index = freeBricks.last();
+                        freeBricks.pop_back();
+                    }
+                    else
+                    {
+                        index = brickOrigins.count() / 3;
+                        brickOrigins.resize(brickOrigins.count() + 3);
+                        samples.resize(samples.count() + BRICK_SAMPLES);
+                    }
+                    brickOrigins[index * 3] = x * BRICK_CELLS;
+                    brickOrigins[index * 3 + 1] = y * BRICK_CELLS;
+                    brickOrigins[index * 3 + 2] = z * BRICK_CELLS;
+                    brickIndices.insert(key, index);
+                }
+
+                if (queued.count() <= index) queued.resize(index + 1);
+                if (!queued[index])
+                {
+                    queued[index] = true;
+                    pending += index;
+                }
+            }
+        }
+    }
+}
+
+void SweepGrid::sampleBricks(int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        int index = pending[i];
+        const int *origin = brickOrigins.constData() + index * 3;
+        float *brick = sampleData + index * BRICK_SAMPLES;
+        bool inBand = false;
+        for (int z = 0; z <= BRICK_CELLS; z++)
+        {
+            for (int y = 0; y <= BRICK_CELLS; y++)
+            {
+                for (int x = 0; x <= BRICK_CELLS; x++)
+                {
+                    Vector3 pos(origin[0] + x, origin[1] + y, origin[2] + z);
+                    float value = tree.minimum(pos * cellSize);
+                    brick[sampleIndex(x, y, z)] = value;
+                    if (fabsf(value) <= band) inBand = true;
+                }
+            }
+        }
+        pendingInBand[i] = inBand;
+    }
+}
+
+int SweepGrid::update(const QVector<Ball> &balls)
+{
+    PROFILE_SCOPE("SweepGrid::update");
+    QVector<Sweep> next;
+    float smallest = FLT_MAX;
+    foreach (const Ball &ball, balls)
+    {
+        next += Sweep(ball, ball.parentIndex == -1 ? ball : balls[ball.parentIndex]);
+        smallest = min(smallest, ball.maxRadius());
+    }
+    if (next.isEmpty())
+    {
+        clear();
+        return 0;
+    }
+
+    // A sample's value can only change where a changed sweep was or is within
+    // the band, because the field is the minimum over all sweeps. Samples
+    // further out may go stale, but lookups never use values outside the band.
+    QVector<char> queued;
+    pending.clear();
+    float size = smallest / cellsPerRadius;
+    for (;;)
+    {
+        double count = 0;
+        foreach (const Sweep &sweep, next)
+        {
+            int lo[3], hi[3];
+            brickRange(sweep, size * BRICK_CELLS, GRID_BAND_CELLS * size, lo, hi);
+            count += (double)(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+        }
+        if (count <= GRID_MAX_BOX_BRICKS) break;
+        size *= 2;
+    }
+
+    if (sweeps.isEmpty() || size < cellSize / 2 || size > cellSize * 2)
+    {
+        clearBricks();
+        cellSize = size;
+        band = GRID_BAND_CELLS * cellSize;
+        foreach (const Sweep &sweep, next)
+            queueRegion(sweep, true, queued);
+    }
+    else
+    {
+        for (int i = 0; i < max(sweeps.count(), next.count()); i++)
+        {
+            bool hasOld = i < sweeps.count(), hasNew = i < next.count();
+            if (hasOld && hasNew && sweeps[i] == next[i]) continue;
+            if (hasOld) queueRegion(sweeps[i], false, queued);
+            if (hasNew) queueRegion(next[i], true, queued);
+        }
+    }
+
+    qSwap(sweeps, next);
+    tree.build(sweeps);
+
+    pendingInBand.resize(pending.count());
+    sampleData = samples.data();
+    parallelFor(pending.count(), this, &SweepGrid::sampleBricks, 4);
+
+    // only keep bricks that touch the band
+    for (int i = 0; i < pending.count(); i++)
+    {
+        if (pendingInBand[i]) continue;
+        int index = pending[i];
+        const int *origin = brickOrigins.constData() + index * 3;
+        brickIndices.remove(brickKey(origin[0] / BRICK_CELLS, origin[1] / BRICK_CELLS, origin[2] / BRICK_CELLS));
+        freeBricks += index;
+    }
+
+    PROFILE_COUNTER("grid bricks", brickIndices.count());
+    return pending.count();
+}
+
+bool SweepGrid::interpolate(const Vector3 &pos, float &value, Vector3 *gradient) const
+{
+    if (brickIndices.isEmpty()) return false;
+    Vector3 cell = pos / cellSize;
+    int corner[3], brick[3];
+    for (int i = 0; i < 3; i++)
+    {
+        float f = floorf(cell.xyz[i]);
+        if (!(fabsf(f) < BRICK_COORD_LIMIT)) return false;
+        corner[i] = (int)f;
+        brick[i] = (int)floorf(f / BRICK_CELLS);
+    }
+    QHash<qint64, int>::const_iterator found = brickIndices.constFind(brickKey(brick[0], brick[1], brick[2]));
+    if (found == brickIndices.constEnd()) return false;
+
+    const float *s = samples.constData() + found.value() * BRICK_SAMPLES + sampleIndex(
+        corner[0] - brick[0] * BRICK_CELLS, corner[1] - brick[1] * BRICK_CELLS, corner[2] - brick[2] * BRICK_CELLS);
+    const int dy = BRICK_CELLS + 1, dz = dy * dy;
+    float c000 = s[0], c100 = s[1], c010 = s[dy], c110 = s[dy + 1];
+    float c001 = s[dz], c101 = s[dz + 1], c011 = s[dz + dy], c111 = s[dz + dy + 1];
+    if (max(max(max(c000, c100), max(c010, c110)), max(max(c001, c101), max(c011, c111))) > band) return false;
+
+    float u = cell.x - corner[0], v = cell.y - corner[1], w = cell.z - corner[2];
+    float c00 = c000 + (c100 - c000) * u, c10 = c010 + (c110 - c010) * u;
+    float c01 = c001 + (c101 - c001) * u, c11 = c011 + (c111 - c011) * u;
+    float c0 = c00 + (c10 - c00) * v, c1 = c01 + (c11 - c01) * v;
+    value = c0 + (c1 - c0) * w;
+
+    if (gradient)
+    {
+        float du = ((c100 - c000) * (1 - v) + (c110 - c010) * v) * (1 - w) + ((c101 - c001) * (1 - v) + (c111 - c011) * v) * w;
+        float dv = (c10 - c00) * (1 - w) + (c11 - c01) * w;
+        *gradient = Vector3(du, dv, c1 - c0) / cellSize;
+    }
+    return true;
+}
+
+float SweepGrid::scalarField(const Vector3 &pos) const
+{
+    float value;
+    if (interpolate(pos, value, NULL)) return value;
+    return tree.minimum(pos);
+}
+
+float SweepGrid::scalarField(const Vector3 &pos, Vector3 &gradient) const
+{
+    float value;
+    if (interpolate(pos, value, &gradient)) return value;
+    return tree.minimum(pos, gradient);
+}
@@ -0,0 +1,65 @@
+#ifndef SWEEPGRID_H
+#define SWEEPGRID_H
+
+#include "meshevolution.h"
+
+/**
+ * A cached, sparse sampling of the MeshEvolution field near the surface. The
+ * samples live in bricks of 8x8x8 cells that are only allocated where the
+ * field is within a few cells of zero, and lookups interpolate trilinearly
+ * between the eight samples around a point. Points away from the band are
+ * evaluated exactly with a SweepTree, so the grid never gives a wrong answer
+ * far from the surface, just a slightly smoothed one near it.
+ *
+ * The grid is kept in sync with the balls by calling update(), which only
+ * resamples the bricks around the sweeps that changed since the last call:
+ *
+ *     grid.update(doc.mesh.balls); // cheap if only one ball moved
+ *     MeshEvolution::run(mesh, &grid);
+ *
+ * Cells are an eighth of the smallest ball radius by default (coarser if that
+ * would need too many bricks). Lookups are usually within a hundredth of a
+ * cell of the exact field, but creases between sweeps get rounded off by up
+ * to a quarter of a cell.
+ */
+class SweepGrid
+{
+private:
+    QVector<Sweep> sweeps;
+    SweepTree tree;
+    float cellSize;
+    float band; // samples with values up to this are kept current
+
+    // brick coordinates are cell coordinates divided by 8 (rounded down)
+    QHash<qint64, int> brickIndices;
+    QVector<int> brickOrigins; // cell coordinates of each brick, 3 per brick
+    QVector<float> samples; // 9x9x9 per brick, the edges are shared with the neighbors
+    QVector<int> freeBricks; // unused slots in brickOrigins and samples
+
+    // bricks to be sampled by sampleBricks() and whether each one touches the band
+    QVector<int> pending;
+    QVector<char> pendingInBand;
+    float *sampleData;
+    void sampleBricks(int begin, int end);
+
+    void clearBricks();
+    void queueRegion(const Sweep &sweep, bool allocate, QVector<char> &queued);
+    bool interpolate(const Vector3 &pos, float &value, Vector3 *gradient) const;
+
+public:
+    float cellsPerRadius;
+
+    SweepGrid();
+
+    // brings the grid up to date with the balls and returns the number of bricks sampled
+    int update(const QVector<Ball> &balls);
+    void clear();
+
+    // the field value, and its gradient, like SweepTree::minimum()
+    float scalarField(const Vector3 &pos) const;
+    float scalarField(const Vector3 &pos, Vector3 &gradient) const;
+
+    int brickCount() const { return brickIndices.count(); }
+};
+
+#endif // SWEEPGRID_H
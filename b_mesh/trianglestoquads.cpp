@@ -1,9 +1,16 @@
 #include "trianglestoquads.h"
-#include <QHash>
+#include "profiler.h"
+#include "parallel.h"
+#include <QBitArray>
+#include <string.h>
 
 inline int min(int a, int b) { return a < b ? a : b; }
 inline int max(int a, int b) { return a > b ? a : b; }
 
+// bits per radix sort pass
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
 Vector3 getNormal(const Mesh &mesh, const Triangle &tri)
 {
     const Vector3 &a = mesh.vertices[tri.a.index].pos;
@@ -12,124 +19,196 @@ Vector3 getNormal(const Mesh &mesh, const Triangle &tri)
     return (c - a).cross(b - a).unit();
 }
 
-void edgeHelper(QVector<int> &indices, int a, int b, const Triangle &tri)
+void edgeHelper(int *indices, int &count, int a, int b, const Triangle &tri)
 {
-    if (tri.a.index == a && tri.b.index == b) indices += tri.c.index;
-    else if (tri.b.index == a && tri.c.index == b) indices += tri.a.index;
-    else if (tri.c.index == a && tri.a.index == b) indices += tri.b.index;
+    if (tri.a.index == a && tri.b.index == b) indices[count++] = tri.c.index;
+    else if (tri.b.index == a && tri.c.index == b) indices[count++] = tri.a.index;
+    else if (tri.c.index == a && tri.a.index == b) indices[count++] = tri.b.index;
 }
 
-struct Edge
+// Merges the two triangles into a quad and scores how good of a quad it is,
+// returns false if they don't share an edge in opposite directions or the
+// quad would use a vertex twice
+static bool scoreMerge(const Mesh &mesh, int indexA, int indexB, Quad &quad, float &score)
 {
-    Quad quad;
-    int indexA, indexB;
-    float score;
-
-    Edge() : indexA(-1), indexB(-1), score(0) {}
+    const Triangle &triA = mesh.triangles[indexA];
+    const Triangle &triB = mesh.triangles[indexB];
+
+    // merge the two triangles
+    int indices[6], count = 0;
+    indices[count++] = triA.a.index;
+    edgeHelper(indices, count, triA.b.index, triA.a.index, triB);
+    indices[count++] = triA.b.index;
+    edgeHelper(indices, count, triA.c.index, triA.b.index, triB);
+    indices[count++] = triA.c.index;
+    edgeHelper(indices, count, triA.a.index, triA.c.index, triB);
+    if (count != 4) return false; // this happens sometimes, like in buddha.obj
+    for (int i = 0; i < 4; i++)
+        for (int j = i + 1; j < 4; j++)
+            if (indices[i] == indices[j]) return false;
+    quad = Quad(indices[0], indices[1], indices[2], indices[3]);
+
+    // compute a score
+    Vector3 normalA = getNormal(mesh, triA);
+    Vector3 normalB = getNormal(mesh, triB);
+    const Vector3 &a = mesh.vertices[quad.a.index].pos;
+    const Vector3 &b = mesh.vertices[quad.b.index].pos;
+    const Vector3 &c = mesh.vertices[quad.c.index].pos;
+    const Vector3 &d = mesh.vertices[quad.d.index].pos;
+    float ac = (a - c).length();
+    float bd = (b - d).length();
+
+    // measure how similar the surface normals are
+    score = normalA.dot(normalB);
+
+    // penalize for quads with different length diagonals
+    score -= fabsf(ac - bd) / (ac + bd);
+
+    // penalize for quads with different diagonal centers
+    score -= (a + c - b - d).length() / (ac + bd);
+
+    return true;
+}
 
-    bool computeScore(const Mesh &mesh)
-    {
-        if (indexA == -1 || indexB == -1) return false;
-
-        const Triangle &triA = mesh.triangles[indexA];
-        const Triangle &triB = mesh.triangles[indexB];
-
-        // merge the two triangles
-        QVector<int> indices;
-        indices += triA.a.index;
-        edgeHelper(indices, triA.b.index, triA.a.index, triB);
-        indices += triA.b.index;
-        edgeHelper(indices, triA.c.index, triA.b.index, triB);
-        indices += triA.c.index;
-        edgeHelper(indices, triA.a.index, triA.c.index, triB);
-        if (indices.count() != 4) return false; // this happens sometimes, like in buddha.obj
-        quad = Quad(indices[0], indices[1], indices[2], indices[3]);
-
-        // compute a score
-        Vector3 normalA = getNormal(mesh, triA);
-        Vector3 normalB = getNormal(mesh, triB);
-        const Vector3 &a = mesh.vertices[quad.a.index].pos;
-        const Vector3 &b = mesh.vertices[quad.b.index].pos;
-        const Vector3 &c = mesh.vertices[quad.c.index].pos;
-        const Vector3 &d = mesh.vertices[quad.d.index].pos;
-        float ac = (a - c).length();
-        float bd = (b - d).length();
-
-        // measure how similar the surface normals are
-        score = normalA.dot(normalB);
-
-        // penalize for quads with different length diagonals
-        score -= fabsf(ac - bd) / (ac + bd);
-
-        // penalize for quads with different diagonal centers
-        score -= (a + c - b - d).length() / (ac + bd);
-
-        return true;
-    }
+// Stable least significant digit radix sort of the values by the low keyBits
+// bits of their keys, only as many passes as those bits need
+static void radixSort(QVector<quint64> &keys, QVector<int> &values, int keyBits)
+{
+    int count = keys.count();
+    QVector<quint64> tempKeys(count);
+    QVector<int> tempValues(count);
+    QVector<int> offsets(RADIX_BUCKETS);
 
-    bool operator < (const Edge &other) const
+    for (int shift = 0; shift < keyBits; shift += RADIX_BITS)
     {
-        return score > other.score;
+        const quint64 *fromKeys = keys.constData();
+        const int *fromValues = values.constData();
+        quint64 *toKeys = tempKeys.data();
+        int *toValues = tempValues.data();
+
+        offsets.fill(0);
+        for (int i = 0; i < count; i++)
+            offsets[(fromKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+        for (int i = 0, total = 0; i < RADIX_BUCKETS; i++)
+        {
+            int bucket = offsets[i];
+            offsets[i] = total;
+            total += bucket;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            int j = offsets[(fromKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+            toKeys[j] = fromKeys[i];
+            toValues[j] = fromValues[i];
+        }
+
+        qSwap(keys, tempKeys);
+        qSwap(values, tempValues);
     }
-};
+}
 
-typedef QPair<int, int> Pair;
+static int bitsFor(quint64 value)
+{
+    int bits = 0;
+    while (bits < 64 && (value >> bits)) bits++;
+    return bits;
+}
 
-Pair makePair(int a, int b)
+// Maps floats to integers with the same order, highest score first. NaN
+// scores (from degenerate triangles) come last.
+static quint64 descendingKey(float score)
 {
-    return Pair(min(a, b), max(a, b));
+    if (score != score) return 0xFFFFFFFF;
+    quint32 bits;
+    memcpy(&bits, &score, sizeof(bits));
+    bits = (bits & 0x80000000) ? ~bits : bits | 0x80000000;
+    return ~bits;
 }
 
-void TrianglesToQuads::run(Mesh &mesh)
+void TrianglesToQuads::findCandidates()
 {
-    QHash<Pair, Edge> edges;
-    QHash<int, bool> triangleDeleted;
+    int numTriangles = mesh.triangles.count();
+    quint64 numVertices = mesh.vertices.count();
 
-    for (int i = 0; i < mesh.triangles.count(); i++)
+    // one key per triangle edge, sorted so the triangles sharing an edge end up next to each other
+    QVector<quint64> keys(numTriangles * 3);
+    QVector<int> triangles(numTriangles * 3);
+    for (int i = 0; i < numTriangles; i++)
     {
         const Triangle &tri = mesh.triangles[i];
-        Pair pair;
-
-        pair = makePair(tri.a.index, tri.b.index);
-        if (edges.contains(pair)) edges[pair].indexB = i;
-        else edges[pair].indexA = i;
-
-        pair = makePair(tri.b.index, tri.c.index);
-        if (edges.contains(pair)) edges[pair].indexB = i;
-        else edges[pair].indexA = i;
+        int corners[3] = { tri.a.index, tri.b.index, tri.c.index };
+        for (int j = 0; j < 3; j++)
+        {
+            int a = corners[j], b = corners[(j + 1) % 3];
+            keys[i * 3 + j] = min(a, b) * numVertices + max(a, b);
+            triangles[i * 3 + j] = i;
+        }
+    }
+    radixSort(keys, triangles, bitsFor(numVertices * numVertices));
 
-        pair = makePair(tri.c.index, tri.a.index);
-        if (edges.contains(pair)) edges[pair].indexB = i;
-        else edges[pair].indexA = i;
+    // only edges with exactly two different triangles can be merged across,
+    // which skips border and non-manifold edges
+    candidates.clear();
+    for (int i = 0; i < keys.count(); )
+    {
+        int end = i + 1;
+        while (end < keys.count() && keys[end] == keys[i]) end++;
+        if (end - i == 2 && triangles[i] != triangles[i + 1])
+            candidates << triangles[i] << triangles[i + 1];
+        i = end;
     }
+}
 
-    // sort triangles by score
-    QVector<Edge> sortedEdges;
-    QHashIterator<Pair, Edge> i(edges);
-    while (i.hasNext())
+void TrianglesToQuads::computeScores(int begin, int end)
+{
+    const int *pairs = candidates.constData();
+    Quad *quads = candidateQuads.data();
+    quint64 *keys = scoreKeys.data();
+
+    for (int i = begin; i < end; i++)
     {
-        i.next();
-        Edge &edge = edges[i.key()];
-        if (edge.computeScore(mesh))
-            sortedEdges += edge;
+        float score;
+        if (scoreMerge(mesh, pairs[i * 2], pairs[i * 2 + 1], quads[i], score)) keys[i] = descendingKey(score);
+        else keys[i] = (quint64)1 << 32;
     }
-    qSort(sortedEdges);
+}
+
+void TrianglesToQuads::run(Mesh &mesh)
+{
+    PROFILE_SCOPE("TrianglesToQuads::run");
+    TrianglesToQuads trianglesToQuads(mesh);
+    trianglesToQuads.findCandidates();
+
+    // score the possible merges and sort them, best first
+    int numCandidates = trianglesToQuads.candidates.count() / 2;
+    trianglesToQuads.candidateQuads.resize(numCandidates);
+    trianglesToQuads.scoreKeys.resize(numCandidates);
+    parallelFor(numCandidates, &trianglesToQuads, &TrianglesToQuads::computeScores);
+    QVector<quint64> &keys = trianglesToQuads.scoreKeys;
+    QVector<int> order(numCandidates);
+    for (int i = 0; i < numCandidates; i++)
+        order[i] = i;
+    radixSort(keys, order, 33);
 
     // convert triangles to quads
-    foreach (const Edge &edge, sortedEdges)
+    QBitArray triangleDeleted(mesh.triangles.count());
+    for (int i = 0; i < numCandidates && keys[i] < ((quint64)1 << 32); i++)
     {
-        if (triangleDeleted[edge.indexA] || triangleDeleted[edge.indexB])
+        int candidate = order[i];
+        int indexA = trianglesToQuads.candidates[candidate * 2];
+        int indexB = trianglesToQuads.candidates[candidate * 2 + 1];
+        if (triangleDeleted.testBit(indexA) || triangleDeleted.testBit(indexB))
             continue;
 
-        triangleDeleted[edge.indexA] = true;
-        triangleDeleted[edge.indexB] = true;
-        mesh.quads += edge.quad;
+        triangleDeleted.setBit(indexA);
+        triangleDeleted.setBit(indexB);
+        mesh.quads += trianglesToQuads.candidateQuads[candidate];
     }
 
     // delete triangles
-    QVector<Triangle> triangles;
+    int count = 0;
     for (int i = 0; i < mesh.triangles.count(); i++)
-        if (!triangleDeleted[i])
-            triangles += mesh.triangles[i];
-    mesh.triangles = triangles;
+        if (!triangleDeleted.testBit(i))
+            mesh.triangles[count++] = mesh.triangles[i];
+    mesh.triangles.resize(count);
 }
@@ -5,7 +5,23 @@
 
 class TrianglesToQuads
 {
+private:
+    Mesh &mesh;
+
+    // the pairs of triangles that share an edge, and the quad and sort key
+    // (from the score) of merging each pair
+    QVector<int> candidates;
+    QVector<Quad> candidateQuads;
+    QVector<quint64> scoreKeys;
+
+    TrianglesToQuads(Mesh &mesh) : mesh(mesh) {}
+    void findCandidates();
+    void computeScores(int begin, int end);
+
 public:
+    // Greedily merges the pairs of triangles across edges into quads, best
+    // scoring pairs (flat, with even diagonals) first. Edges on borders or
+    // with more than two triangles are left alone.
     static void run(Mesh &mesh);
 };
 
@@ -0,0 +1,18 @@
+# Headless version of "Run Everything" for processing many skeletons offline:
+#   qmake batch.pro CONFIG+=release && make
+#   ./batch -o out/ data/*.obj
+QT       += core gui opengl
+TARGET = batch
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+# NDEBUG disables asserts
+release {
+    DEFINES += NDEBUG
+}
+
+include(../core.pri)
+
+SOURCES += \
+    main.cpp
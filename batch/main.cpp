@@ -0,0 +1,195 @@
+#include "meshconstruction.h"
+#include "catmullclark.h"
+#include "adaptivesubdivision.h"
+#include "meshevolution.h"
+#include "edgefairing.h"
+#include "profiler.h"
+#include <QtConcurrentMap>
+#include <QThreadPool>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+struct Options
+{
+    int subdivisionLevels;
+    int fairingIterations;
+    float adaptiveBend;
+    bool evolve;
+    bool converge;
+    bool implicitFairing;
+    std::string outputDirectory;
+
+    Options() : subdivisionLevels(3), fairingIterations(15), adaptiveBend(0), evolve(true), converge(false), implicitFairing(false) {}
+};
+
+struct Job
+{
+    const Options *options;
+    std::string input;
+    std::string output;
+    bool succeeded;
+};
+
+static QMutex printMutex;
+
+static int usage(const char *program)
+{
+    printf("usage: %s [options] skeleton.obj ...\n\n", program);
+    printf("Runs the same pipeline as \"Run Everything\" on each skeleton and writes the\n");
+    printf("result to <name>.mesh.obj. Files are processed concurrently.\n\n");
+    printf("options:\n");
+    printf("  -o <directory>      where to write results (default: next to each input)\n");
+    printf("  -levels <n>         number of subdivide/evolve/fair rounds (default: 3)\n");
+    printf("  -fairing <n>        edge fairing iterations per round, 0 to skip (default: 15)\n");
+    printf("  -implicit-fairing   one implicit fairing solve per round instead, as strong as\n");
+    printf("                      the -fairing iterations\n");
+    printf("  -adaptive <bend>    only subdivide faces bending more than this many radians\n");
+    printf("  -no-evolution       skip MeshEvolution in each round\n");
+    printf("  -converge           evolve until the surface converges instead of one step\n");
+    printf("  -jobs <n>           number of files to process at once (default: one per core)\n");
+#ifdef ENABLE_PROFILER
+    printf("  -trace <file>       write Chrome trace event JSON for every stage\n");
+#endif
+    return 1;
+}
+
+static std::string outputPath(const std::string &input, const std::string &directory)
+{
+    // strip the directory and the extension
+    size_t slash = input.find_last_of("/\\");
+    std::string name = (slash == std::string::npos) ? input : input.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0) name = name.substr(0, dot);
+
+    std::string dir = directory;
+    if (dir.empty()) dir = (slash == std::string::npos) ? "" : input.substr(0, slash + 1);
+    else if (dir[dir.size() - 1] != '/' && dir[dir.size() - 1] != '\\') dir += '/';
+    return dir + name + ".mesh.obj";
+}
+
+static void runJob(Job &job)
+{
+    const Options &options = *job.options;
+    QElapsedTimer timer;
+    timer.start();
+    job.succeeded = false;
+
+    PROFILE_SCOPE("batch file");
+    Mesh mesh;
+    if (!mesh.loadFromOBJ(job.input))
+    {
+        QMutexLocker locker(&printMutex);
+        fprintf(stderr, "could not read from \"%s\"\n", job.input.c_str());
+        return;
+    }
+
+    // meshes without a skeleton are refined as they are
+    if (!mesh.balls.isEmpty())
+    {
+        mesh.updateChildIndices();
+        MeshConstruction::BMeshInit(mesh);
+    }
+
+    AdaptiveSubdivision adaptive;
+    adaptive.maxBend = options.adaptiveBend;
+    QVector<bool> refine;
+
+    for (int i = 0; i < options.subdivisionLevels; i++)
+    {
+        if (options.adaptiveBend > 0)
+        {
+            adaptive.markFaces(mesh, refine);
+            CatmullMesh::subdivide(mesh, mesh, refine);
+        }
+        else CatmullMesh::subdivide(mesh);
+        if (options.evolve && !mesh.balls.isEmpty())
+        {
+            if (options.converge) MeshEvolution::runToConvergence(mesh);
+            else MeshEvolution::run(mesh);
+        }
+        if (options.fairingIterations > 0)
+        {
+            if (options.implicitFairing) EdgeFairing::runImplicit(mesh, 0.1f * options.fairingIterations);
+            else EdgeFairing::run(mesh, options.fairingIterations);
+        }
+    }
+
+    if (!mesh.saveToOBJ(job.output))
+    {
+        QMutexLocker locker(&printMutex);
+        fprintf(stderr, "could not write to \"%s\"\n", job.output.c_str());
+        return;
+    }
+
+    job.succeeded = true;
+    QMutexLocker locker(&printMutex);
+    printf("%s: %d vertices, %d quads, %d triangles in %.3f s\n", job.output.c_str(),
+        mesh.vertices.count(), mesh.quads.count(), mesh.triangles.count(), timer.elapsed() / 1000.0);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    int jobs = QThread::idealThreadCount();
+#ifdef ENABLE_PROFILER
+    const char *trace = NULL;
+#endif
+    QList<Job> queue;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "-o") && hasValue) options.outputDirectory = argv[++i];
+        else if (!strcmp(arg, "-levels") && hasValue) options.subdivisionLevels = atoi(argv[++i]);
+        else if (!strcmp(arg, "-fairing") && hasValue) options.fairingIterations = atoi(argv[++i]);
+        else if (!strcmp(arg, "-adaptive") && hasValue) options.adaptiveBend = atof(argv[++i]);
+        else if (!strcmp(arg, "-no-evolution")) options.evolve = false;
+        else if (!strcmp(arg, "-converge")) options.converge = true;
+        else if (!strcmp(arg, "-implicit-fairing")) options.implicitFairing = true;
+        else if (!strcmp(arg, "-jobs") && hasValue) jobs = atoi(argv[++i]);
+#ifdef ENABLE_PROFILER
+        else if (!strcmp(arg, "-trace") && hasValue) trace = argv[++i];
+#endif
+        else if (arg[0] == '-') return usage(argv[0]);
+        else
+        {
+            Job job;
+            job.options = &options;
+            job.input = arg;
+            job.succeeded = false;
+            queue += job;
+        }
+    }
+    if (queue.isEmpty())
+        return usage(argv[0]);
+
+    // -o can come after the inputs, so name the outputs once every option is read
+    for (int i = 0; i < queue.count(); i++)
+        queue[i].output = outputPath(queue[i].input, options.outputDirectory);
+
+    // each file is independent, so run one per thread
+    QElapsedTimer timer;
+    timer.start();
+    if (jobs > 0) QThreadPool::globalInstance()->setMaxThreadCount(jobs);
+    QtConcurrent::blockingMap(queue, runJob);
+
+    int failed = 0;
+    foreach (const Job &job, queue)
+        if (!job.succeeded) failed++;
+    printf("processed %d files (%d failed) in %.3f s\n", queue.count(), failed, timer.elapsed() / 1000.0);
+
+#ifdef ENABLE_PROFILER
+    if (trace && !Profiler::writeTrace(trace))
+    {
+        fprintf(stderr, "could not write to \"%s\"\n", trace);
+        return 1;
+    }
+#endif
+    return failed ? 1 : 0;
+}
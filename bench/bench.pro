@@ -0,0 +1,26 @@
+# Command-line benchmarks for the geometry code. Build in release mode:
+#   qmake bench.pro CONFIG+=release && make
+QT       += core gui opengl
+TARGET = bench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+# NDEBUG disables asserts
+release {
+    DEFINES += NDEBUG
+}
+
+include(../core.pri)
+
+HEADERS += \
+    benchmark.h
+
+SOURCES += \
+    main.cpp \
+    benchmark.cpp \
+    hullbenchmark.cpp \
+    modelbenchmark.cpp \
+    threadbenchmark.cpp \
+    evolutionbenchmark.cpp \
+    fairingbenchmark.cpp
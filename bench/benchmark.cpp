@@ -0,0 +1,88 @@
+#include "benchmark.h"
+#include "meshconstruction.h"
+#include "catmullclark.h"
+#include "meshevolution.h"
+#include <sys/resource.h>
+#include <stdio.h>
+#include <string.h>
+
+void seedRandom(unsigned int seed)
+{
+    srand(seed);
+}
+
+double elapsedMilliseconds(const QElapsedTimer &timer)
+{
+    return timer.nsecsElapsed() / 1.0e6;
+}
+
+bool loadBenchmarkMesh(const char *path, int levels, bool evolve, Mesh &mesh)
+{
+    if (!mesh.loadFromOBJ(path))
+        return false;
+    if (!mesh.balls.isEmpty())
+    {
+        mesh.vertices.clear();
+        mesh.triangles.clear();
+        mesh.quads.clear();
+        mesh.updateChildIndices();
+        MeshConstruction::BMeshInit(mesh);
+    }
+    for (int i = 0; i < levels; i++)
+    {
+        CatmullMesh::subdivide(mesh);
+        if (evolve && !mesh.balls.isEmpty()) MeshEvolution::run(mesh);
+    }
+    mesh.updateNormals();
+    return true;
+}
+
+void randomPointCloud(int n, bool onSurface, QVector<Vector3> &points)
+{
+    points.clear();
+    points.reserve(n);
+    for (int i = 0; i < n; i++)
+    {
+        float radius = onSurface ? 1 : powf(frand(), 1.0f / 3.0f);
+        points += Vector3::uniform() * radius;
+    }
+}
+
+void resetPeakMemory()
+{
+#ifdef __linux__
+    // writing 5 resets the peak resident set size (VmHWM) to the current size
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if (file)
+    {
+        fputs("5", file);
+        fclose(file);
+    }
+#endif
+}
+
+long peakMemoryKilobytes()
+{
+#ifdef __linux__
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file)
+    {
+        char line[256];
+        long kilobytes = -1;
+        while (fgets(line, sizeof(line), file))
+            if (!strncmp(line, "VmHWM:", 6))
+                kilobytes = atol(line + 6);
+        fclose(file);
+        if (kilobytes >= 0)
+            return kilobytes;
+    }
+#endif
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes on Mac OS X
+#else
+    return usage.ru_maxrss;
+#endif
+}
@@ -0,0 +1,44 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QElapsedTimer>
+#include <QVector>
+#include "vector.h"
+
+class Mesh;
+
+/**
+ * Shared helpers for the command-line benchmarks. Each benchmark is a
+ * function that takes the remaining command-line arguments and returns
+ * the process exit code.
+ */
+
+int hullBenchmark(int argc, char **argv);
+int modelBenchmark(int argc, char **argv);
+int threadBenchmark(int argc, char **argv);
+int evolutionBenchmark(int argc, char **argv);
+int fairingBenchmark(int argc, char **argv);
+
+// seeds rand() so every run benchmarks the same input
+void seedRandom(unsigned int seed);
+
+// milliseconds elapsed since timer.start(), with sub-millisecond precision
+double elapsedMilliseconds(const QElapsedTimer &timer);
+
+// The model's B-Mesh (or the stored mesh if it has no skeleton) subdivided
+// the given number of times, evolving after each level if evolve is true
+// and there is a skeleton, with up-to-date normals. Returns false if the
+// file can't be read.
+bool loadBenchmarkMesh(const char *path, int levels, bool evolve, Mesh &mesh);
+
+// n points distributed uniformly inside the unit ball, or on its surface
+void randomPointCloud(int n, bool onSurface, QVector<Vector3> &points);
+
+// start measuring peak memory from the current resident set size (only
+// supported on Linux, elsewhere the peak is for the whole process)
+void resetPeakMemory();
+
+// peak resident set size in kilobytes since the last resetPeakMemory()
+long peakMemoryKilobytes();
+
+#endif // BENCHMARK_H
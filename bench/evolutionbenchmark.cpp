@@ -0,0 +1,150 @@
+#include "benchmark.h"
+#include "meshevolution.h"
+#include "sweepgrid.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// evolved positions may differ from the serial reference by this much times
+// the size of the model. The vector path does the same float operations and
+// breaks ties the same way, so in practice they match exactly, but a compiler
+// is free to contract the scalar code into fused multiply-adds
+#define EVOLUTION_TOLERANCE 1e-5f
+
+// MeshEvolution the way it used to be: every sweep in order for every vertex
+// on one thread, with the same per-sweep field and gradient
+static void serialEvolution(Mesh &mesh)
+{
+    QVector<Sweep> sweeps;
+    foreach (const Ball &ball, mesh.balls)
+        sweeps += Sweep(ball, ball.parentIndex == -1 ? ball : mesh.balls[ball.parentIndex]);
+
+    for (int i = 0; i < mesh.vertices.count(); i++)
+    {
+        Vertex &vertex = mesh.vertices[i];
+        float best = FLT_MAX;
+        Vector3 normal;
+        foreach (const Sweep &sweep, sweeps)
+        {
+            Vector3 gradient;
+            float curr = sweep.scalarField(vertex.pos, gradient);
+            if (curr < best)
+            {
+                best = curr;
+                normal = gradient;
+            }
+        }
+        float len = normal.length();
+        normal = (len < 1e-6) ? Vector3() : normal / len;
+        vertex.pos -= normal * best;
+    }
+    mesh.updateNormals();
+}
+
+static const SweepGrid *currentGrid = NULL;
+
+static void evolve(Mesh &mesh)
+{
+    MeshEvolution::run(mesh, currentGrid);
+}
+
+static double timeEvolution(void (*evolve)(Mesh &mesh), const Mesh &input, int repetitions, Mesh &output)
+{
+    double best = 0;
+    for (int r = 0; r < repetitions; r++)
+    {
+        output = input;
+        QElapsedTimer timer;
+        timer.start();
+        evolve(output);
+        double elapsed = elapsedMilliseconds(timer);
+        if (r == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int evolutionBenchmark(int argc, char **argv)
+{
+    int levels = 3;
+    int repetitions = 3;
+    bool useGrid = false;
+    QVector<const char *> paths;
+
+    for (int i = 0; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "-levels") && hasValue) levels = qMax(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-repeat") && hasValue) repetitions = qMax(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-grid")) useGrid = true;
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "unknown option \"%s\"\n", argv[i]);
+            return 1;
+        }
+        else paths += argv[i];
+    }
+    if (paths.isEmpty())
+    {
+        fprintf(stderr, "no models given\n");
+        return 1;
+    }
+
+    int failures = 0;
+    printf("# model\tballs\tvertices\tserial_ms\tevolve_ms\tspeedup\tmax_difference%s\n",
+        useGrid ? "\tgrid_build_ms\tgrid_evolve_ms\tgrid_max_difference" : "");
+
+    foreach (const char *path, paths)
+    {
+        Mesh input;
+        // the input to the last evolution of "Run Everything"
+        if (!loadBenchmarkMesh(path, levels, false, input) || input.balls.isEmpty())
+        {
+            fprintf(stderr, "could not read a skeleton from \"%s\"\n", path);
+            continue;
+        }
+
+        Mesh reference, evolved;
+        double serial = timeEvolution(serialEvolution, input, repetitions, reference);
+        currentGrid = NULL;
+        double parallel = timeEvolution(evolve, input, repetitions, evolved);
+
+        Vector3 minCorner(FLT_MAX, FLT_MAX, FLT_MAX), maxCorner(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        float difference = 0;
+        for (int i = 0; i < reference.vertices.count(); i++)
+        {
+            minCorner = Vector3::min(minCorner, reference.vertices[i].pos);
+            maxCorner = Vector3::max(maxCorner, reference.vertices[i].pos);
+            difference = qMax(difference, (reference.vertices[i].pos - evolved.vertices[i].pos).length());
+        }
+        if (difference > EVOLUTION_TOLERANCE * (maxCorner - minCorner).length())
+            failures++;
+
+        printf("%s\t%d\t%d\t%.3f\t%.3f\t%.2f\t%g", path, input.balls.count(), input.vertices.count(),
+            serial, parallel, serial / qMax(parallel, 1.0e-9), difference);
+
+        // the grid is an approximation, so it is reported but never fails
+        if (useGrid)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            SweepGrid grid;
+            grid.update(input.balls);
+            double build = elapsedMilliseconds(timer);
+
+            Mesh gridEvolved;
+            currentGrid = &grid;
+            double gridEvolve = timeEvolution(evolve, input, repetitions, gridEvolved);
+            float gridDifference = 0;
+            for (int i = 0; i < reference.vertices.count(); i++)
+                gridDifference = qMax(gridDifference, (reference.vertices[i].pos - gridEvolved.vertices[i].pos).length());
+            printf("\t%.3f\t%.3f\t%g", build, gridEvolve, gridDifference);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (failures)
+        fprintf(stderr, "%d models evolved differently than the serial reference\n", failures);
+    return failures ? 2 : 0;
+}
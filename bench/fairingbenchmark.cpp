@@ -0,0 +1,157 @@
+#include "benchmark.h"
+#include "edgefairing.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// how far each vertex ended up from where the reference put it, relative to the size of the model
+static void measureDifference(const Mesh &mesh, const Mesh &reference, float size, double &maxDifference, double &meanDifference)
+{
+    double totalDifference = 0;
+    maxDifference = 0;
+    for (int i = 0; i < mesh.vertices.count(); i++)
+    {
+        double difference = (mesh.vertices[i].pos - reference.vertices[i].pos).length() / size;
+        maxDifference = qMax(maxDifference, difference);
+        totalDifference += difference;
+    }
+    meanDifference = totalDifference / qMax(mesh.vertices.count(), 1);
+}
+
+int fairingBenchmark(int argc, char **argv)
+{
+    int levels = 3;
+    int iterations = 15;
+    int repetitions = 3;
+    int rings = 8;
+    QVector<int> intervals;
+    intervals << 1 << 2 << 4 << 8;
+    QVector<const char *> paths;
+
+    for (int i = 0; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "-levels") && hasValue) levels = qMax(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-iterations") && hasValue) iterations = qMax(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-repeat") && hasValue) repetitions = qMax(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-rings") && hasValue) rings = qMax(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-intervals") && hasValue)
+        {
+            // comma-separated list
+            intervals.clear();
+            for (char *interval = strtok(argv[++i], ","); interval; interval = strtok(NULL, ","))
+                intervals += qMax(1, atoi(interval));
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "unknown option \"%s\"\n", argv[i]);
+            return 1;
+        }
+        else paths += argv[i];
+    }
+    if (paths.isEmpty())
+    {
+        fprintf(stderr, "no models given\n");
+        return 1;
+    }
+
+    // differences are relative to the size of the model and to refreshing
+    // the normals after every iteration
+    printf("# model\tvertices\tnormal_interval\tms\tspeedup\tmax_difference\tmean_difference\n");
+
+    foreach (const char *path, paths)
+    {
+        Mesh input;
+        // the mesh "Run Everything" fairs in its last round
+        if (!loadBenchmarkMesh(path, levels, true, input))
+        {
+            fprintf(stderr, "could not read from \"%s\"\n", path);
+            continue;
+        }
+
+        Vector3 minCorner(FLT_MAX, FLT_MAX, FLT_MAX), maxCorner(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        foreach (const Vertex &vertex, input.vertices)
+        {
+            minCorner = Vector3::min(minCorner, vertex.pos);
+            maxCorner = Vector3::max(maxCorner, vertex.pos);
+        }
+        float size = qMax((maxCorner - minCorner).length(), FLT_MIN);
+
+        Mesh reference = input;
+        EdgeFairing::run(reference, iterations, 1);
+        double everyIteration = 0;
+
+        for (int n = 0; n < intervals.count(); n++)
+        {
+            double best = 0;
+            Mesh mesh;
+            for (int r = 0; r < repetitions; r++)
+            {
+                mesh = input;
+                QElapsedTimer timer;
+                timer.start();
+                EdgeFairing::run(mesh, iterations, intervals[n]);
+                double elapsed = elapsedMilliseconds(timer);
+                if (r == 0 || elapsed < best) best = elapsed;
+            }
+            if (n == 0) everyIteration = best;
+
+            double maxDifference, meanDifference;
+            measureDifference(mesh, reference, size, maxDifference, meanDifference);
+            printf("%s\t%d\t%d\t%.3f\t%.2f\t%g\t%g\n", path, mesh.vertices.count(), intervals[n], best,
+                everyIteration / qMax(best, 1.0e-9), maxDifference, meanDifference);
+            fflush(stdout);
+        }
+
+        // one implicit solve of the same strength, then a second one warm-started from the first
+        double best = 0, warm = 0;
+        int coldIterations = 0, warmIterations = 0;
+        Mesh mesh;
+        for (int r = 0; r < repetitions; r++)
+        {
+            mesh = input;
+            QVector<Vector3> guess;
+            QElapsedTimer timer;
+            timer.start();
+            coldIterations = EdgeFairing::runImplicit(mesh, 0.1f * iterations, &guess);
+            double elapsed = elapsedMilliseconds(timer);
+            if (r == 0 || elapsed < best) best = elapsed;
+
+            Mesh again = mesh;
+            timer.start();
+            warmIterations = EdgeFairing::runImplicit(again, 0.1f * iterations, &guess);
+            elapsed = elapsedMilliseconds(timer);
+            if (r == 0 || elapsed < warm) warm = elapsed;
+        }
+
+        double maxDifference, meanDifference;
+        measureDifference(mesh, reference, size, maxDifference, meanDifference);
+        printf("%s\t%d\timplicit\t%.3f\t%.2f\t%g\t%g\n", path, mesh.vertices.count(), best,
+            everyIteration / qMax(best, 1.0e-9), maxDifference, meanDifference);
+        printf("# %d conjugate gradient iterations, a second warm-started solve took %d in %.3f ms\n",
+            coldIterations, warmIterations, warm);
+
+        // cleaning up a local edit: the neighbors are found once, then only
+        // the region around the edit is faired
+        Mesh local = input;
+        QElapsedTimer timer;
+        timer.start();
+        EdgeFairing regionFairing(local);
+        double setup = elapsedMilliseconds(timer);
+        QVector<int> seeds;
+        seeds += 0;
+        double region = 0;
+        for (int r = 0; r < repetitions; r++)
+        {
+            timer.start();
+            regionFairing.runRegion(seeds, rings, iterations);
+            double elapsed = elapsedMilliseconds(timer);
+            if (r == 0 || elapsed < region) region = elapsed;
+        }
+        printf("# fairing %d rings around vertex 0 took %.3f ms, after %.3f ms finding the neighbors once\n",
+            rings, region, setup);
+        fflush(stdout);
+    }
+    return 0;
+}
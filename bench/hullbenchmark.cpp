@@ -0,0 +1,119 @@
+#include "benchmark.h"
+#include "convexhull3d.h"
+#include <stdio.h>
+
+struct HullMethod
+{
+    ConvexHull3D::Backend backend;
+    Wm5::Query::Type type;
+    const char *name;
+};
+
+static const HullMethod hullMethods[] = {
+    { ConvexHull3D::WM5, Wm5::Query::QT_REAL, "QT_REAL" },
+    { ConvexHull3D::WM5, Wm5::Query::QT_INT64, "QT_INT64" },
+    { ConvexHull3D::WM5, Wm5::Query::QT_FILTERED, "QT_FILTERED" },
+    { ConvexHull3D::WM5, Wm5::Query::QT_RATIONAL, "QT_RATIONAL" },
+    { ConvexHull3D::CHULL, Wm5::Query::QT_REAL, "Chull3D" },
+};
+
+static const int numHullMethods = sizeof(hullMethods) / sizeof(hullMethods[0]);
+
+// generates the same kind of point cloud that MeshConstruction hands to
+// ConvexHull3D at a joint: one quad per bone leaving the ball, shrunk to
+// 1% of its size, so every cloud is made of nearly coplanar clusters
+static void jointPointClouds(const Mesh &skeleton, QVector<QVector<Vector3> > &clouds)
+{
+    Mesh mesh;
+    mesh.balls = skeleton.balls;
+    mesh.updateChildIndices();
+
+    for (int i = 0; i < mesh.balls.count(); i++)
+    {
+        const Ball &ball = mesh.balls[i];
+        if (ball.childrenIndices.count() < 2)
+            continue;
+
+        QVector<int> neighbors = ball.childrenIndices;
+        if (ball.parentIndex != -1)
+            neighbors += ball.parentIndex;
+
+        QVector<Vector3> cloud;
+        float r = ball.maxRadius();
+        foreach (int neighbor, neighbors)
+        {
+            Vector3 x = (mesh.balls[neighbor].center - ball.center).unit();
+            Vector3 y = (fabsf(x.dot(Vector3::Y)) < 0.5 ? Vector3::Y : Vector3::X).cross(x).unit() * r;
+            Vector3 z = x.cross(y).unit() * r;
+            Vector3 center = ball.center + x * r;
+            const float percent = 0.01f;
+            cloud += center + (y + z) * percent;
+            cloud += center + (z - y) * percent;
+            cloud += center - (y + z) * percent;
+            cloud += center + (y - z) * percent;
+        }
+        clouds += cloud;
+    }
+}
+
+// runs every cloud through the hull once per repetition and reports the
+// fastest repetition, along with the total face count as a sanity check
+static void benchmarkClouds(const char *label, const QVector<QVector<Vector3> > &clouds, int repetitions)
+{
+    int numPoints = 0;
+    foreach (const QVector<Vector3> &cloud, clouds)
+        numPoints += cloud.count();
+    printf("%s (%d clouds, %d points)\n", label, clouds.count(), numPoints);
+
+    for (int m = 0; m < numHullMethods; m++)
+    {
+        double best = 0;
+        int faces = 0;
+        for (int r = 0; r < repetitions; r++)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            faces = 0;
+            foreach (const QVector<Vector3> &cloud, clouds)
+            {
+                Mesh mesh;
+                foreach (const Vector3 &point, cloud)
+                    mesh.vertices += Vertex(point);
+                ConvexHull3D::run(mesh, hullMethods[m].type, hullMethods[m].backend);
+                faces += mesh.triangles.count();
+            }
+            double elapsed = elapsedMilliseconds(timer);
+            if (r == 0 || elapsed < best) best = elapsed;
+        }
+        printf("  %-12s %10.3f ms %8d faces\n", hullMethods[m].name, best, faces);
+        fflush(stdout);
+    }
+    printf("\n");
+}
+
+int hullBenchmark(int argc, char **argv)
+{
+    QVector<QVector<Vector3> > clouds;
+    for (int i = 0; i < argc; i++)
+    {
+        Mesh skeleton;
+        if (!skeleton.loadFromOBJ(argv[i]))
+        {
+            fprintf(stderr, "could not read from \"%s\"\n", argv[i]);
+            return 1;
+        }
+        jointPointClouds(skeleton, clouds);
+    }
+    if (!clouds.isEmpty())
+        benchmarkClouds("joint point clouds", clouds, 20);
+
+    seedRandom(0);
+    for (int surface = 0; surface < 2; surface++)
+    {
+        QVector<QVector<Vector3> > random(1);
+        randomPointCloud(100000, surface, random[0]);
+        benchmarkClouds(surface ? "100k points on a sphere" : "100k points in a ball", random, 1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include "benchmark.h"
+#include <string.h>
+#include <stdio.h>
+
+static int usage(const char *program)
+{
+    printf("usage: %s <benchmark> [arguments]\n\n", program);
+    printf("benchmarks:\n");
+    printf("  hull [skeleton.obj ...]    convex hull backends on joint and random point clouds\n");
+    printf("  models [options] model.obj ...\n");
+    printf("                             every pipeline stage on each model, tab-separated\n");
+    printf("      -levels <n>            subdivision levels to time (default: 4)\n");
+    printf("      -repeat <n>            repetitions per stage, the fastest is kept (default: 3)\n");
+    printf("      -save <file>           write the results as a baseline\n");
+    printf("      -baseline <file>       compare against a saved baseline, exit status 2 on a regression\n");
+    printf("      -threshold <percent>   allowed slowdown or memory growth (default: 15)\n");
+    printf("  threads [options] model.obj ...\n");
+    printf("                             multithreaded stages at increasing thread counts, exit\n");
+    printf("                             status 2 if the output depends on the thread count\n");
+    printf("      -levels <n>            subdivision level to time (default: 4)\n");
+    printf("      -repeat <n>            repetitions per thread count, the fastest is kept (default: 3)\n");
+    printf("      -threads <n,n,...>     thread counts to run (default: 1, 2, 4, ... up to the core count)\n");
+    printf("  evolution [options] skeleton.obj ...\n");
+    printf("                             MeshEvolution against a serial loop over every sweep, exit\n");
+    printf("                             status 2 if the results differ by more than the tolerance\n");
+    printf("      -levels <n>            subdivision level of the evolved mesh (default: 3)\n");
+    printf("      -repeat <n>            repetitions, the fastest is kept (default: 3)\n");
+    printf("      -grid                  also time evolving with a SweepGrid, and its error\n");
+    printf("  fairing [options] model.obj ...\n");
+    printf("                             EdgeFairing refreshing normals at different intervals, and\n");
+    printf("                             how far the result moves from refreshing every iteration,\n");
+    printf("                             the implicit mode of the same strength, and fairing only\n");
+    printf("                             a region around one vertex\n");
+    printf("      -levels <n>            subdivision level of the faired mesh (default: 3)\n");
+    printf("      -iterations <n>        fairing iterations (default: 15)\n");
+    printf("      -intervals <n,n,...>   normal refresh intervals to run (default: 1, 2, 4, 8)\n");
+    printf("      -repeat <n>            repetitions per interval, the fastest is kept (default: 3)\n");
+    printf("      -rings <n>             size of the region faired around one vertex (default: 8)\n");
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+        return usage(argv[0]);
+
+    const char *name = argv[1];
+    if (!strcmp(name, "hull")) return hullBenchmark(argc - 2, argv + 2);
+    if (!strcmp(name, "models")) return modelBenchmark(argc - 2, argv + 2);
+    if (!strcmp(name, "threads")) return threadBenchmark(argc - 2, argv + 2);
+    if (!strcmp(name, "evolution")) return evolutionBenchmark(argc - 2, argv + 2);
+    if (!strcmp(name, "fairing")) return fairingBenchmark(argc - 2, argv + 2);
+
+    return usage(argv[0]);
+}
@@ -0,0 +1,360 @@
+#include "benchmark.h"
+#include "meshconstruction.h"
+#include "catmullclark.h"
+#include "meshevolution.h"
+#include "edgefairing.h"
+#include "trianglestoquads.h"
+#include "convexhull3d.h"
+#include "curvature.h"
+#include "subdivisionstencils.h"
+#include "limitsurface.h"
+#include <QMap>
+#include <string>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// the fairing pass used by "Run Everything"
+#define FAIRING_ITERATIONS 15
+
+// stages that take less time or memory than this never count as regressions,
+// they are too small to measure reliably
+#define MIN_REGRESSION_MILLISECONDS 1.0
+#define MIN_REGRESSION_KILOBYTES 1024
+
+// the subdivision level "Run Everything" ends at, used for the stencil and limit surface stages
+#define STENCIL_LEVELS 3
+
+struct StageResult
+{
+    std::string model;
+    std::string stage;
+    double milliseconds;
+    int faces;
+    long peakKilobytes;
+};
+
+typedef void (*StageFunction)(Mesh &mesh);
+
+// results and baselines share one tab-separated format, so the output can be
+// diffed, graphed or saved as a baseline
+#define RESULT_HEADER "# model\tstage\tms\tfaces\tfaces_per_sec\tpeak_rss_kb\n"
+
+static void printResult(FILE *file, const StageResult &result)
+{
+    fprintf(file, "%s\t%s\t%.3f\t%d\t%.0f\t%ld\n", result.model.c_str(), result.stage.c_str(), result.milliseconds,
+        result.faces, result.faces / qMax(result.milliseconds / 1000.0, 1.0e-9), result.peakKilobytes);
+}
+
+static void construct(Mesh &mesh)
+{
+    mesh.updateChildIndices();
+    MeshConstruction::BMeshInit(mesh);
+}
+
+static void subdivide(Mesh &mesh)
+{
+    CatmullMesh::subdivide(mesh);
+}
+
+static void evolve(Mesh &mesh)
+{
+    MeshEvolution::run(mesh);
+}
+
+static void fair(Mesh &mesh)
+{
+    EdgeFairing::run(mesh, FAIRING_ITERATIONS);
+}
+
+static void curvature(Mesh &mesh)
+{
+    Curvature curvature;
+    curvature.computeCurvatures(mesh);
+}
+
+static void trianglesToQuads(Mesh &mesh)
+{
+    TrianglesToQuads::run(mesh);
+}
+
+static void convexHull(Mesh &mesh)
+{
+    ConvexHull3D::run(mesh);
+}
+
+// built by the stencil_build stage and reused by stencil_apply
+static SubdivisionStencils stencils;
+
+static void buildStencils(Mesh &mesh)
+{
+    stencils.build(mesh, STENCIL_LEVELS);
+}
+
+// what posing costs per frame with stencils, compare with subdividing the
+// base mesh STENCIL_LEVELS times
+static void applyStencils(Mesh &mesh)
+{
+    stencils.apply(mesh, mesh);
+}
+
+// limit positions and normals at the same resolution, compare with the
+// subdivide stages and the normals they compute
+static void limitSurface(Mesh &mesh)
+{
+    LimitSurface::evaluate(mesh, STENCIL_LEVELS, mesh);
+}
+
+// splits every quad along its shorter diagonal so TrianglesToQuads has
+// something realistic to pair back up
+static void triangulate(Mesh &mesh)
+{
+    foreach (const Quad &quad, mesh.quads)
+    {
+        const Vector3 &a = mesh.vertices[quad.a.index].pos;
+        const Vector3 &b = mesh.vertices[quad.b.index].pos;
+        const Vector3 &c = mesh.vertices[quad.c.index].pos;
+        const Vector3 &d = mesh.vertices[quad.d.index].pos;
+        if ((a - c).lengthSquared() < (b - d).lengthSquared())
+        {
+            mesh.triangles += Triangle(quad.a.index, quad.b.index, quad.c.index);
+            mesh.triangles += Triangle(quad.a.index, quad.c.index, quad.d.index);
+        }
+        else
+        {
+            mesh.triangles += Triangle(quad.a.index, quad.b.index, quad.d.index);
+            mesh.triangles += Triangle(quad.b.index, quad.c.index, quad.d.index);
+        }
+    }
+    mesh.quads.clear();
+}
+
+static std::string modelName(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    std::string name = slash ? slash + 1 : path;
+    size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+// runs the stage on a fresh copy of input for each repetition and keeps the
+// fastest time, output receives the result of the last repetition
+static StageResult runStage(const std::string &model, const std::string &stage, const Mesh &input,
+    StageFunction function, int repetitions, Mesh &output)
+{
+    StageResult result;
+    result.model = model;
+    result.stage = stage;
+    result.milliseconds = 0;
+    result.peakKilobytes = 0;
+
+    for (int r = 0; r < repetitions; r++)
+    {
+        Mesh mesh = input;
+        resetPeakMemory();
+        QElapsedTimer timer;
+        timer.start();
+        function(mesh);
+        double elapsed = elapsedMilliseconds(timer);
+        long peak = peakMemoryKilobytes();
+
+        if (r == 0 || elapsed < result.milliseconds) result.milliseconds = elapsed;
+        if (peak > result.peakKilobytes) result.peakKilobytes = peak;
+        result.faces = mesh.triangles.count() + mesh.quads.count();
+
+        if (r + 1 == repetitions)
+            output = mesh;
+    }
+
+    printResult(stdout, result);
+    fflush(stdout);
+    return result;
+}
+
+static void benchmarkModel(const char *path, int levels, int repetitions, QVector<StageResult> &results)
+{
+    Mesh loaded;
+    if (!loaded.loadFromOBJ(path))
+    {
+        fprintf(stderr, "could not read from \"%s\"\n", path);
+        return;
+    }
+    std::string model = modelName(path);
+    Mesh base, temp;
+
+    // start from the skeleton if there is one, otherwise from the stored mesh
+    if (!loaded.balls.isEmpty())
+    {
+        Mesh skeleton;
+        skeleton.balls = loaded.balls;
+        results += runStage(model, "construction", skeleton, construct, repetitions, base);
+    }
+    else
+    {
+        base.vertices = loaded.vertices;
+        base.triangles = loaded.triangles;
+        base.quads = loaded.quads;
+    }
+    if (base.quads.isEmpty() && base.triangles.isEmpty())
+        return;
+
+    // each level subdivides the result of the previous one
+    Mesh levelMeshes[2];
+    Mesh current = base;
+    for (int level = 1; level <= levels; level++)
+    {
+        char stage[32];
+        sprintf(stage, "subdivide_%d", level);
+        Mesh next;
+        results += runStage(model, stage, current, subdivide, repetitions, next);
+        current = next;
+        if (level <= 2) levelMeshes[level - 1] = next;
+    }
+
+    // the remaining stages run where "Run Everything" would use them: the
+    // first round of evolution and fairing, then analysis on the next level
+    const Mesh &level1 = levels >= 1 ? levelMeshes[0] : base;
+    const Mesh &level2 = levels >= 2 ? levelMeshes[1] : level1;
+    if (!level1.balls.isEmpty())
+        results += runStage(model, "evolution", level1, evolve, repetitions, temp);
+    results += runStage(model, "fairing", level1, fair, repetitions, temp);
+    results += runStage(model, "curvature", level2, curvature, repetitions, temp);
+
+    Mesh triangulated = level2;
+    triangulate(triangulated);
+    results += runStage(model, "triangles_to_quads", triangulated, trianglesToQuads, repetitions, temp);
+
+    Mesh points;
+    points.vertices = level2.vertices;
+    results += runStage(model, "convex_hull", points, convexHull, repetitions, temp);
+
+    results += runStage(model, "stencil_build", base, buildStencils, repetitions, temp);
+    if (!stencils.isEmpty())
+        results += runStage(model, "stencil_apply", base, applyStencils, repetitions, temp);
+    results += runStage(model, "limit_surface", base, limitSurface, repetitions, temp);
+}
+
+static bool writeResults(const char *path, const QVector<StageResult> &results)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, RESULT_HEADER);
+    foreach (const StageResult &result, results)
+        printResult(file, result);
+    return fclose(file) == 0;
+}
+
+static bool readResults(const char *path, QMap<std::string, StageResult> &results)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+    char line[1024], model[256], stage[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        StageResult result;
+        if (line[0] == '#' || sscanf(line, "%255s %255s %lf %d %*f %ld", model, stage,
+                &result.milliseconds, &result.faces, &result.peakKilobytes) != 5)
+            continue;
+        result.model = model;
+        result.stage = stage;
+        results.insert(result.model + "/" + result.stage, result);
+    }
+    fclose(file);
+    return true;
+}
+
+// returns the number of stages that got slower or used more memory than
+// the baseline allows
+static int compareResults(const QVector<StageResult> &results, const QMap<std::string, StageResult> &baseline, double threshold)
+{
+    int regressions = 0;
+    foreach (const StageResult &result, results)
+    {
+        std::string key = result.model + "/" + result.stage;
+        if (!baseline.contains(key))
+        {
+            fprintf(stderr, "new: %s has no baseline\n", key.c_str());
+            continue;
+        }
+
+        const StageResult &old = baseline[key];
+        if (result.faces != old.faces)
+            fprintf(stderr, "changed: %s produced %d faces instead of %d\n", key.c_str(), result.faces, old.faces);
+
+        double timeLimit = qMax(old.milliseconds * (1 + threshold), old.milliseconds + MIN_REGRESSION_MILLISECONDS);
+        if (result.milliseconds > timeLimit)
+        {
+            fprintf(stderr, "regression: %s took %.3f ms, baseline %.3f ms (%+.1f%%)\n", key.c_str(),
+                result.milliseconds, old.milliseconds, (result.milliseconds / old.milliseconds - 1) * 100);
+            regressions++;
+        }
+
+        double memoryLimit = qMax(old.peakKilobytes * (1 + threshold), (double)old.peakKilobytes + MIN_REGRESSION_KILOBYTES);
+        if (result.peakKilobytes > memoryLimit)
+        {
+            fprintf(stderr, "regression: %s peaked at %ld kB, baseline %ld kB (%+.1f%%)\n", key.c_str(),
+                result.peakKilobytes, old.peakKilobytes, (result.peakKilobytes / (double)old.peakKilobytes - 1) * 100);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int modelBenchmark(int argc, char **argv)
+{
+    int levels = 4;
+    int repetitions = 3;
+    double threshold = 0.15;
+    const char *baselinePath = NULL;
+    const char *savePath = NULL;
+    QVector<const char *> paths;
+
+    for (int i = 0; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "-levels") && hasValue) levels = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-repeat") && hasValue) repetitions = qMax(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-threshold") && hasValue) threshold = atof(argv[++i]) / 100;
+        else if (!strcmp(argv[i], "-baseline") && hasValue) baselinePath = argv[++i];
+        else if (!strcmp(argv[i], "-save") && hasValue) savePath = argv[++i];
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "unknown option \"%s\"\n", argv[i]);
+            return 1;
+        }
+        else paths += argv[i];
+    }
+    if (paths.isEmpty())
+    {
+        fprintf(stderr, "no models given\n");
+        return 1;
+    }
+
+    QMap<std::string, StageResult> baseline;
+    if (baselinePath && !readResults(baselinePath, baseline))
+    {
+        fprintf(stderr, "could not read from \"%s\"\n", baselinePath);
+        return 1;
+    }
+
+    printf(RESULT_HEADER);
+    QVector<StageResult> results;
+    foreach (const char *path, paths)
+        benchmarkModel(path, levels, repetitions, results);
+
+    if (savePath && !writeResults(savePath, results))
+    {
+        fprintf(stderr, "could not write to \"%s\"\n", savePath);
+        return 1;
+    }
+
+    if (baselinePath)
+    {
+        int regressions = compareResults(results, baseline, threshold);
+        fprintf(stderr, "%d regressions over %.0f%% against \"%s\"\n", regressions, threshold * 100, baselinePath);
+        return regressions ? 2 : 0;
+    }
+    return 0;
+}
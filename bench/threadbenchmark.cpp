@@ -0,0 +1,166 @@
+#include "benchmark.h"
+#include "catmullclark.h"
+#include "meshevolution.h"
+#include "edgefairing.h"
+#include <QThreadPool>
+#include <QThread>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef void (*StageFunction)(Mesh &mesh);
+
+struct ThreadedStage
+{
+    const char *name;
+    StageFunction function;
+};
+
+static void subdivide(Mesh &mesh)
+{
+    CatmullMesh::subdivide(mesh);
+}
+
+static void evolve(Mesh &mesh)
+{
+    MeshEvolution::run(mesh);
+}
+
+static void fair(Mesh &mesh)
+{
+    EdgeFairing::run(mesh, 15);
+}
+
+static const ThreadedStage stages[] = {
+    { "subdivide", subdivide },
+    { "evolve", evolve },
+    { "fair", fair },
+};
+
+static const int numStages = sizeof(stages) / sizeof(stages[0]);
+
+// true if both meshes have the same faces and bit-identical vertices
+static bool sameMesh(const Mesh &a, const Mesh &b)
+{
+    if (a.vertices.count() != b.vertices.count() || a.triangles.count() != b.triangles.count() || a.quads.count() != b.quads.count())
+        return false;
+
+    for (int i = 0; i < a.vertices.count(); i++)
+    {
+        const Vertex &va = a.vertices[i], &vb = b.vertices[i];
+        if (memcmp(&va.pos, &vb.pos, sizeof(Vector3)) || memcmp(&va.normal, &vb.normal, sizeof(Vector3)) || va.jointWeights != vb.jointWeights)
+            return false;
+    }
+    for (int i = 0; i < a.triangles.count(); i++)
+    {
+        const Triangle &ta = a.triangles[i], &tb = b.triangles[i];
+        if (ta.a.index != tb.a.index || ta.b.index != tb.b.index || ta.c.index != tb.c.index)
+            return false;
+    }
+    for (int i = 0; i < a.quads.count(); i++)
+    {
+        const Quad &qa = a.quads[i], &qb = b.quads[i];
+        if (qa.a.index != qb.a.index || qa.b.index != qb.b.index || qa.c.index != qb.c.index || qa.d.index != qb.d.index)
+            return false;
+    }
+    return true;
+}
+
+// 1, 2, 4, ... up to and including the number of cores
+static QVector<int> defaultThreadCounts()
+{
+    QVector<int> counts;
+    int cores = QThread::idealThreadCount();
+    for (int n = 1; n < cores; n *= 2)
+        counts += n;
+    counts += qMax(cores, 1);
+    return counts;
+}
+
+int threadBenchmark(int argc, char **argv)
+{
+    int levels = 4;
+    int repetitions = 3;
+    QVector<int> threadCounts = defaultThreadCounts();
+    QVector<const char *> paths;
+
+    for (int i = 0; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "-levels") && hasValue) levels = qMax(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-repeat") && hasValue) repetitions = qMax(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-threads") && hasValue)
+        {
+            // comma-separated list
+            threadCounts.clear();
+            for (char *count = strtok(argv[++i], ","); count; count = strtok(NULL, ","))
+                threadCounts += qMax(1, atoi(count));
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "unknown option \"%s\"\n", argv[i]);
+            return 1;
+        }
+        else paths += argv[i];
+    }
+    if (paths.isEmpty())
+    {
+        fprintf(stderr, "no models given\n");
+        return 1;
+    }
+
+    int originalThreads = QThreadPool::globalInstance()->maxThreadCount();
+    int mismatches = 0;
+    printf("# model\tstage\tthreads\tms\tspeedup\tidentical\n");
+
+    foreach (const char *path, paths)
+    {
+        Mesh input;
+        // the input for the threaded stages is subdivided one level less than the level being timed
+        if (!loadBenchmarkMesh(path, levels - 1, false, input))
+        {
+            fprintf(stderr, "could not read from \"%s\"\n", path);
+            continue;
+        }
+
+        for (int s = 0; s < numStages; s++)
+        {
+            Mesh reference;
+            double singleThreaded = 0;
+
+            for (int t = 0; t < threadCounts.count(); t++)
+            {
+                QThreadPool::globalInstance()->setMaxThreadCount(threadCounts[t]);
+                double best = 0;
+                Mesh mesh;
+                for (int r = 0; r < repetitions; r++)
+                {
+                    mesh = input;
+                    QElapsedTimer timer;
+                    timer.start();
+                    stages[s].function(mesh);
+                    double elapsed = elapsedMilliseconds(timer);
+                    if (r == 0 || elapsed < best) best = elapsed;
+                }
+
+                // the first thread count is the reference for speed and output
+                if (t == 0)
+                {
+                    reference = mesh;
+                    singleThreaded = best;
+                }
+                bool identical = sameMesh(reference, mesh);
+                if (!identical) mismatches++;
+
+                printf("%s\t%s\t%d\t%.3f\t%.2f\t%s\n", path, stages[s].name, threadCounts[t], best,
+                    singleThreaded / qMax(best, 1.0e-9), identical ? "yes" : "no");
+                fflush(stdout);
+            }
+        }
+    }
+
+    QThreadPool::globalInstance()->setMaxThreadCount(originalThreads);
+    if (mismatches)
+        fprintf(stderr, "%d runs produced different output than with %d threads\n", mismatches, threadCounts[0]);
+    return mismatches ? 2 : 0;
+}
@@ -0,0 +1,103 @@
+# Everything except the Qt user interface, shared by cs224final.pro and the
+# command-line tools so they always build the exact same geometry code.
+# Paths are relative to $$PWD so this can be included from subdirectories.
+
+# scoped timers and allocation counts for the pipeline stages, written to
+# trace.json on exit (the GUI also draws the latest timings in the viewport)
+# DEFINES += ENABLE_PROFILER
+
+INCLUDEPATH += $$PWD/doc $$PWD/util $$PWD/b_mesh
+DEPENDPATH += $$PWD/doc $$PWD/util $$PWD/b_mesh
+
+HEADERS += \
+    $$PWD/util/vector.h \
+    $$PWD/util/geometry.h \
+    $$PWD/doc/mesh.h \
+    $$PWD/doc/document.h \
+    $$PWD/b_mesh/meshconstruction.h \
+    $$PWD/util/selectionrecorder.h \
+    $$PWD/util/raytracer.h \
+    $$PWD/b_mesh/catmullclark.h \
+    $$PWD/b_mesh/subdivisionstencils.h \
+    $$PWD/b_mesh/limitsurface.h \
+    $$PWD/b_mesh/adaptivesubdivision.h \
+    $$PWD/doc/commands.h \
+    $$PWD/b_mesh/meshevolution.h \
+    $$PWD/b_mesh/sweepgrid.h \
+    $$PWD/b_mesh/edgefairing.h \
+    $$PWD/util/chull.h \
+    $$PWD/util/convexhull3d.h \
+    $$PWD/util/curvature.h \
+    $$PWD/util/matrix.h \
+    $$PWD/b_mesh/trianglestoquads.h \
+    $$PWD/util/shader.h \
+    $$PWD/util/texture.h \
+    $$PWD/util/metamesh.h \
+    $$PWD/util/meshacceleration.h \
+    $$PWD/util/meshinfo.h \
+    $$PWD/util/profiler.h \
+    $$PWD/util/parallel.h
+
+SOURCES += \
+    $$PWD/doc/document.cpp \
+    $$PWD/util/geometry.cpp \
+    $$PWD/doc/mesh.cpp \
+    $$PWD/b_mesh/meshconstruction.cpp \
+    $$PWD/doc/objfileformat.cpp \
+    $$PWD/util/selectionrecorder.cpp \
+    $$PWD/util/raytracer.cpp \
+    $$PWD/b_mesh/catmullclark.cpp \
+    $$PWD/b_mesh/subdivisionstencils.cpp \
+    $$PWD/b_mesh/limitsurface.cpp \
+    $$PWD/b_mesh/adaptivesubdivision.cpp \
+    $$PWD/doc/commands.cpp \
+    $$PWD/b_mesh/meshevolution.cpp \
+    $$PWD/b_mesh/sweepgrid.cpp \
+    $$PWD/b_mesh/edgefairing.cpp \
+    $$PWD/util/chull.cpp \
+    $$PWD/util/convexhull3d.cpp \
+    $$PWD/util/curvature.cpp \
+    $$PWD/util/matrix.cpp \
+    $$PWD/b_mesh/trianglestoquads.cpp \
+    $$PWD/util/shader.cpp \
+    $$PWD/util/texture.cpp \
+    $$PWD/util/metamesh.cpp \
+    $$PWD/util/meshacceleration.cpp \
+    $$PWD/util/meshinfo.cpp \
+    $$PWD/util/vector.cpp \
+    $$PWD/util/profiler.cpp
+
+# find . -type d | sed 's/$/ \\/' | sed 's/\.\//$$PWD\/util\/wm5\//'
+INCLUDEPATH += \
+    $$PWD/util/wm5/LibCore \
+    $$PWD/util/wm5/LibCore/Assert \
+    $$PWD/util/wm5/LibCore/DataTypes \
+    $$PWD/util/wm5/LibCore/Memory \
+    $$PWD/util/wm5/LibMathematics \
+    $$PWD/util/wm5/LibMathematics/Base \
+    $$PWD/util/wm5/LibMathematics/Algebra \
+    $$PWD/util/wm5/LibMathematics/ComputationalGeometry \
+    $$PWD/util/wm5/LibMathematics/Query \
+    $$PWD/util/wm5/LibMathematics/Rational
+
+# find . -name *.cpp | sed 's/$/ \\/' | sed 's/\.\//$$PWD\/util\/wm5\//'
+SOURCES += \
+    $$PWD/util/wm5/LibCore/Assert/Wm5Assert.cpp \
+    $$PWD/util/wm5/LibCore/Wm5CorePCH.cpp \
+    $$PWD/util/wm5/LibMathematics/Algebra/Wm5Vector2.cpp \
+    $$PWD/util/wm5/LibMathematics/Algebra/Wm5Vector3.cpp \
+    $$PWD/util/wm5/LibMathematics/Algebra/Wm5Vector4.cpp \
+    $$PWD/util/wm5/LibMathematics/Base/Wm5BitHacks.cpp \
+    $$PWD/util/wm5/LibMathematics/Base/Wm5Float1.cpp \
+    $$PWD/util/wm5/LibMathematics/Base/Wm5Float2.cpp \
+    $$PWD/util/wm5/LibMathematics/Base/Wm5Float3.cpp \
+    $$PWD/util/wm5/LibMathematics/Base/Wm5Float4.cpp \
+    $$PWD/util/wm5/LibMathematics/Base/Wm5Math.cpp \
+    $$PWD/util/wm5/LibMathematics/ComputationalGeometry/Wm5ConvexHull.cpp \
+    $$PWD/util/wm5/LibMathematics/ComputationalGeometry/Wm5ConvexHull1.cpp \
+    $$PWD/util/wm5/LibMathematics/ComputationalGeometry/Wm5ConvexHull2.cpp \
+    $$PWD/util/wm5/LibMathematics/ComputationalGeometry/Wm5ConvexHull3.cpp \
+    $$PWD/util/wm5/LibMathematics/Query/Wm5Query.cpp \
+    $$PWD/util/wm5/LibMathematics/Rational/Wm5IVector2.cpp \
+    $$PWD/util/wm5/LibMathematics/Rational/Wm5IVector3.cpp \
+    $$PWD/util/wm5/LibMathematics/Wm5MathematicsPCH.cpp
@@ -10,12 +10,14 @@ void AddBallCommand::undo()
 {
     doc->mesh.balls.pop_back();
     doc->emitDocumentChanged();
+    doc->emitTopologyChanged();
 }
 
 void AddBallCommand::redo()
 {
     doc->mesh.balls += ball;
     doc->emitDocumentChanged();
+    doc->emitTopologyChanged();
 }
 
 MoveBallCommand::MoveBallCommand(Document *doc, int index, const Vector3 &delta) : index(index), doc(doc)
@@ -28,12 +30,14 @@ void MoveBallCommand::undo()
 {
     doc->mesh.balls[index].center = oldCenter;
     doc->emitDocumentChanged();
+    doc->emitTopologyChanged();
 }
 
 void MoveBallCommand::redo()
 {
     doc->mesh.balls[index].center = newCenter;
     doc->emitDocumentChanged();
+    doc->emitTopologyChanged();
 }
 
 ScaleBallCommand::ScaleBallCommand(Document *doc, int index, const Vector3 &x, const Vector3 &y, const Vector3 &z) : index(index), doc(doc)
@@ -54,6 +58,7 @@ void ScaleBallCommand::undo()
     ball.ey = oldY;
     ball.ez = oldZ;
     doc->emitDocumentChanged();
+    doc->emitTopologyChanged();
 }
 
 void ScaleBallCommand::redo()
@@ -63,6 +68,7 @@ void ScaleBallCommand::redo()
     ball.ey = newY;
     ball.ez = newZ;
     doc->emitDocumentChanged();
+    doc->emitTopologyChanged();
 }
 
 DeleteBallCommand::DeleteBallCommand(Document *doc, int index) : index(index), doc(doc), ball(doc->mesh.balls[index])
@@ -84,6 +90,7 @@ void DeleteBallCommand::undo()
     // can now modify the list
     doc->mesh.balls.insert(index, ball);
     doc->emitDocumentChanged();
+    doc->emitTopologyChanged();
 }
 
 void DeleteBallCommand::redo()
@@ -104,6 +111,7 @@ void DeleteBallCommand::redo()
     // can now modify the list
     doc->mesh.balls.remove(index);
     doc->emitDocumentChanged();
+    doc->emitTopologyChanged();
 }
 
 ChangeMeshCommand::ChangeMeshCommand(Document *doc, const QVector<Ball> &balls, const QVector<Vertex> &vertices, const QVector<Triangle> &triangles, const QVector<Quad> &quads)
@@ -123,6 +131,7 @@ void ChangeMeshCommand::undo()
     doc->mesh.quads = oldQuads;
     doc->mesh.uploadToGPU();
     doc->emitDocumentChanged();
+    doc->emitTopologyChanged();
 }
 
 void ChangeMeshCommand::redo()
@@ -133,6 +142,7 @@ void ChangeMeshCommand::redo()
     doc->mesh.quads = newQuads;
     doc->mesh.uploadToGPU();
     doc->emitDocumentChanged();
+    doc->emitTopologyChanged();
 }
 
 ChangeVerticesCommand::ChangeVerticesCommand(Document *doc, const QVector<int> &vertexIndices, const QVector<Vertex> &newVertices)
@@ -28,10 +28,14 @@ public:
 
     void emitDocumentChanged() { emit documentChanged(); }
     void emitVerticesChanged(const QVector<int> &vertexIndices) { emit verticesChanged(vertexIndices); }
+    void emitTopologyChanged() { emit topologyChanged(); }
 
 signals:
+    // every change emits documentChanged(), and then either verticesChanged()
+    // when only existing vertices moved or topologyChanged() for anything else
     void documentChanged();
     void verticesChanged(const QVector<int> &vertexIndices);
+    void topologyChanged();
 };
 
 #endif // DOCUMENT_H
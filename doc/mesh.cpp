@@ -1,5 +1,6 @@
 #include "mesh.h"
 #include "geometry.h"
+#include "profiler.h"
 #include <QSet>
 #define GL_GLEXT_PROTOTYPES
 #include <qgl.h>
@@ -81,6 +82,7 @@ void Mesh::updateChildIndices()
 
 void Mesh::updateNormals()
 {
+    PROFILE_SCOPE("Mesh::updateNormals");
     for (int i = 0; i < vertices.count(); i++)
     {
         Vertex &vertex = vertices[i];
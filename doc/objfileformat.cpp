@@ -1,99 +1,422 @@
 #include "mesh.h"
+#include "profiler.h"
+#include "parallel.h"
+#include <QFile>
 #include <float.h>
-#include <fstream>
-#include <vector>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
 using namespace std;
 
-inline int getInt(const string &str)
+// the most tokens any line we read has ("j" lines), faces can have more
+#define MAX_OBJ_TOKENS 14
+
+// exactly representable powers of ten for parseFloat()
+static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// the same as atoi() on the token, which stops at the '/' before texture
+// coordinate and normal indices
+static int parseInt(const char *p, const char *end)
 {
-    string::size_type slash = str.find('/');
-    return atoi((slash == string::npos ? str : str.substr(0, slash)).c_str());
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    long long value = 0;
+    while (p < end && *p >= '0' && *p <= '9' && value < INT_MAX)
+        value = value * 10 + (*p++ - '0');
+    return (int)(negative ? -value : value);
 }
 
-void split(string str, const string &split, vector<string> &result)
+// The same float as atof() on the token. Plain decimals with at most 19
+// significant digits and a small exponent are exact in a double after one
+// multiplication or division, so only anything else needs strtod().
+static float parseFloat(const char *p, const char *end)
 {
-    // trim characters in split from the start of str
-    string::size_type start = str.find_first_not_of(split);
-    if (start != string::npos) str = str.substr(start);
+    const char *s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) negative = *s++ == '-';
+
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool anyDigits = false, exact = true;
+    for (; s < end && *s >= '0' && *s <= '9'; s++)
+    {
+        anyDigits = true;
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*s - '0');
+            if (mantissa) digits++;
+        }
+        else
+        {
+            if (*s != '0') exact = false;
+            exponent++;
+        }
+    }
+    if (s < end && *s == '.')
+    {
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++)
+        {
+            anyDigits = true;
+            if (digits >= 19)
+            {
+                if (*s != '0') exact = false;
+                continue;
+            }
+            mantissa = mantissa * 10 + (*s - '0');
+            if (mantissa) digits++;
+            exponent--;
+        }
+    }
+    if (anyDigits && s < end && (*s == 'e' || *s == 'E'))
+    {
+        const char *e = s + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+')) negativeExponent = *e++ == '-';
+        if (e < end && *e >= '0' && *e <= '9')
+        {
+            int value = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; e++)
+                if (value < 10000) value = value * 10 + (*e - '0');
+            exponent += negativeExponent ? -value : value;
+            s = e;
+        }
+    }
 
-    // trim characters in split from the end of str
-    string::size_type end = str.find_last_not_of(split);
-    if (end != string::npos) str = str.substr(0, end + 1);
+    if (anyDigits && exact && s == end && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / powersOfTen[-exponent] : value * powersOfTen[exponent];
+        return (float)(negative ? -value : value);
+    }
 
-    // perform the split
-    start = 0;
-    while ((end = str.find_first_of(split, start)) != string::npos)
+    // everything else (hex, inf, nan, long mantissas, trailing junk)
+    char buffer[64];
+    if (end - p < (int)sizeof(buffer))
     {
-        result.push_back(str.substr(start, end - start));
-        start = str.find_first_not_of(split, end);
-        if (start == string::npos) return;
+        memcpy(buffer, p, end - p);
+        buffer[end - p] = '\0';
+        return atof(buffer);
     }
-    result.push_back(str.substr(start));
+    return atof(string(p, end).c_str());
 }
 
-bool Mesh::loadFromOBJ(const string &file)
+// counts the tokens on the line and remembers where the first few start and end
+static int tokenize(const char *p, const char *end, const char **starts, const char **ends)
+{
+    int count = 0;
+    for (;;)
+    {
+        while (p < end && isSpace(*p)) p++;
+        if (p == end) return count;
+        const char *start = p;
+        while (p < end && !isSpace(*p)) p++;
+        if (count < MAX_OBJ_TOKENS)
+        {
+            starts[count] = start;
+            ends[count] = p;
+        }
+        count++;
+    }
+}
+
+static bool isKeyword(const char *start, const char *end, char keyword)
+{
+    return end - start == 1 && *start == keyword;
+}
+
+// the end of the line starting at p, not including the newline or a carriage return before it
+static const char *lineEnd(const char *p, const char *end, const char *&next)
 {
-    ifstream f(file.c_str());
-    if (!f.good()) return false;
+    const char *newline = (const char *)memchr(p, '\n', end - p);
+    next = newline ? newline + 1 : end;
+    if (!newline) newline = end;
+    if (newline > p && newline[-1] == '\r') newline--;
+    return newline;
+}
 
-    balls.clear();
-    vertices.clear();
-    triangles.clear();
-    quads.clear();
+// what parseLines() reads from a range of lines
+struct OBJContents
+{
+    QVector<Vertex> vertices;
+    QVector<Triangle> triangles;
+    QVector<Quad> quads;
+    QVector<Ball> balls;
+    Vector3 minVertex, maxVertex;
 
-    string line;
-    Vector3 minVertex(FLT_MAX, FLT_MAX, FLT_MAX);
-    Vector3 maxVertex(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-    while (getline(f, line))
+    // corners (face * 3 + corner, or face * 4 + corner) that were negative
+    // in the file, so far only resolved relative to the first vertex here
+    QVector<int> relativeTriangleCorners;
+    QVector<int> relativeQuadCorners;
+
+    OBJContents() : minVertex(FLT_MAX, FLT_MAX, FLT_MAX), maxVertex(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+};
+
+// Reserves room for everything in the lines, which is much cheaper than
+// parsing them because it only has to look at the first character of most
+static void reserveLines(const char *p, const char *end, OBJContents &contents)
+{
+    const char *starts[MAX_OBJ_TOKENS], *ends[MAX_OBJ_TOKENS];
+    int numVertices = 0, numTriangles = 0, numQuads = 0;
+    while (p < end)
     {
-        // remove the trailing newline
-        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.end() - 1);
-        if (!line.empty() && line[line.size() - 1] == '\n') line.erase(line.end() - 1);
+        const char *next, *stop = lineEnd(p, end, next);
+        while (p < stop && isSpace(*p)) p++;
+        if (stop - p > 1 && isSpace(p[1]))
+        {
+            if (*p == 'v') numVertices++;
+            else if (*p == 'f')
+            {
+                int count = tokenize(p, stop, starts, ends);
+                if (count == 5) numQuads++;
+                else if (count > 5) numTriangles += count - 3;
+                else if (count == 4) numTriangles++;
+            }
+        }
+        p = next;
+    }
+    contents.vertices.reserve(numVertices);
+    contents.triangles.reserve(numTriangles);
+    contents.quads.reserve(numQuads);
+}
+
+// OBJ indices start at one, and negative ones count back from the last
+// vertex so far (-1 is the previous vertex)
+static int parseIndex(const char *start, const char *end, int numVertices, bool &relative)
+{
+    int index = parseInt(start, end);
+    relative = index < 0;
+    return relative ? numVertices + index : index - 1;
+}
 
-        vector<string> parts;
-        split(line, " ", parts);
+static void parseLines(const char *p, const char *end, OBJContents &contents)
+{
+    const char *starts[MAX_OBJ_TOKENS], *ends[MAX_OBJ_TOKENS];
+    while (p < end)
+    {
+        const char *next, *stop = lineEnd(p, end, next);
+        int count = tokenize(p, stop, starts, ends);
+        p = next;
+        if (count == 0) continue;
 
-        if (parts[0] == "v" && parts.size() == 4)
+        if (isKeyword(starts[0], ends[0], 'v') && count == 4)
         {
-            float x = atof(parts[1].c_str());
-            float y = atof(parts[2].c_str());
-            float z = atof(parts[3].c_str());
-            Vector3 pos(x, y, z);
-            minVertex = Vector3::min(minVertex, pos);
-            maxVertex = Vector3::max(maxVertex, pos);
-            vertices += Vertex(pos);
+            Vector3 pos(parseFloat(starts[1], ends[1]), parseFloat(starts[2], ends[2]), parseFloat(starts[3], ends[3]));
+            contents.minVertex = Vector3::min(contents.minVertex, pos);
+            contents.maxVertex = Vector3::max(contents.maxVertex, pos);
+            contents.vertices += Vertex(pos);
         }
-        else if (parts[0] == "f" && parts.size() >= 4)
+        else if (isKeyword(starts[0], ends[0], 'f') && count >= 4)
         {
-            int a = getInt(parts[1]) - 1;
-            int b = getInt(parts[2]) - 1;
-            if (parts.size() == 5)
+            int numVertices = contents.vertices.count();
+            int indices[4];
+            bool relative[4];
+            indices[0] = parseIndex(starts[1], ends[1], numVertices, relative[0]);
+            indices[1] = parseIndex(starts[2], ends[2], numVertices, relative[1]);
+            if (count == 5)
             {
-                int c = getInt(parts[3]) - 1;
-                int d = getInt(parts[4]) - 1;
-                quads += Quad(a, b, c, d);
+                indices[2] = parseIndex(starts[3], ends[3], numVertices, relative[2]);
+                indices[3] = parseIndex(starts[4], ends[4], numVertices, relative[3]);
+                for (int i = 0; i < 4; i++)
+                    if (relative[i]) contents.relativeQuadCorners += contents.quads.count() * 4 + i;
+                contents.quads += Quad(indices[0], indices[1], indices[2], indices[3]);
             }
             else
             {
-                for (unsigned int i = 3; i < parts.size(); i++)
+                // a fan around the first vertex, walking the rest of the
+                // line since there can be more tokens than were remembered
+                const char *token = ends[2];
+                for (int i = 3; i < count; i++)
                 {
-                    int c = getInt(parts[i]) - 1;
-                    triangles += Triangle(a, b, c);
-                    b = c;
+                    while (isSpace(*token)) token++;
+                    const char *tokenEnd = token;
+                    while (tokenEnd < stop && !isSpace(*tokenEnd)) tokenEnd++;
+                    indices[2] = parseIndex(token, tokenEnd, numVertices, relative[2]);
+                    for (int j = 0; j < 3; j++)
+                        if (relative[j]) contents.relativeTriangleCorners += contents.triangles.count() * 3 + j;
+                    contents.triangles += Triangle(indices[0], indices[1], indices[2]);
+                    indices[1] = indices[2];
+                    relative[1] = relative[2];
+                    token = tokenEnd;
                 }
             }
         }
-        else if (parts[0] == "j" && parts.size() == 14)
+        else if (isKeyword(starts[0], ends[0], 'j') && count == 14)
         {
+            float values[12];
+            for (int i = 0; i < 12; i++)
+                values[i] = parseFloat(starts[i + 1], ends[i + 1]);
             Ball ball;
-            ball.center = Vector3(atof(parts[1].c_str()), atof(parts[2].c_str()), atof(parts[3].c_str()));
-            ball.ex = Vector3(atof(parts[4].c_str()), atof(parts[5].c_str()), atof(parts[6].c_str()));
-            ball.ey = Vector3(atof(parts[7].c_str()), atof(parts[8].c_str()), atof(parts[9].c_str()));
-            ball.ez = Vector3(atof(parts[10].c_str()), atof(parts[11].c_str()), atof(parts[12].c_str()));
-            ball.parentIndex = atoi(parts[13].c_str()) - 1;
-            balls += ball;
+            ball.center = Vector3(values[0], values[1], values[2]);
+            ball.ex = Vector3(values[3], values[4], values[5]);
+            ball.ey = Vector3(values[6], values[7], values[8]);
+            ball.ez = Vector3(values[9], values[10], values[11]);
+            ball.parentIndex = parseInt(starts[13], ends[13]) - 1;
+            contents.balls += ball;
         }
     }
+}
+
+static Index &triangleCorner(Triangle &tri, int corner)
+{
+    return corner == 0 ? tri.a : corner == 1 ? tri.b : tri.c;
+}
+
+static Index &quadCorner(Quad &quad, int corner)
+{
+    return corner == 0 ? quad.a : corner == 1 ? quad.b : corner == 2 ? quad.c : quad.d;
+}
+
+// Large files are cut into chunks at line boundaries and the chunks are
+// parsed on the global QThreadPool (see parallel.h). Prefix sums of the
+// chunk sizes then say where each chunk goes in the mesh, which is also
+// when the relative indices in a chunk can be resolved.
+class OBJParser
+{
+public:
+    OBJParser(const char *data, qint64 size);
+    void parseChunks(int begin, int end);
+    void copyChunks(int begin, int end);
+    void run(Mesh &mesh, Vector3 &minVertex, Vector3 &maxVertex);
+
+private:
+    QVector<const char *> chunkStarts;
+    QVector<OBJContents> chunks;
+    QVector<int> vertexOffsets;
+    QVector<int> triangleOffsets;
+    QVector<int> quadOffsets;
+    Vertex *vertices;
+    Triangle *triangles;
+    Quad *quads;
+};
+
+// don't bother with threads for chunks smaller than this
+#define MIN_OBJ_CHUNK_SIZE (1 << 20)
+
+OBJParser::OBJParser(const char *data, qint64 size) : vertices(NULL), triangles(NULL), quads(NULL)
+{
+    int threads = QThreadPool::globalInstance()->maxThreadCount();
+    int numChunks = (int)qMax((qint64)1, qMin((qint64)threads * 4, size / MIN_OBJ_CHUNK_SIZE));
+
+    // move each cut forward to the start of the next line
+    const char *end = data + size;
+    chunkStarts += data;
+    for (int i = 1; i < numChunks; i++)
+    {
+        const char *cut = qMax(data + size * i / numChunks, chunkStarts.last());
+        const char *newline = (const char *)memchr(cut, '\n', end - cut);
+        chunkStarts += newline ? newline + 1 : end;
+    }
+    chunkStarts += end;
+    chunks.resize(numChunks);
+}
+
+void OBJParser::parseChunks(int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        reserveLines(chunkStarts[i], chunkStarts[i + 1], chunks[i]);
+        parseLines(chunkStarts[i], chunkStarts[i + 1], chunks[i]);
+    }
+}
+
+void OBJParser::copyChunks(int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        const OBJContents &chunk = chunks[i];
+        Vertex *chunkVertices = vertices + vertexOffsets[i];
+        Triangle *chunkTriangles = triangles + triangleOffsets[i];
+        Quad *chunkQuads = quads + quadOffsets[i];
+
+        for (int j = 0; j < chunk.vertices.count(); j++)
+            chunkVertices[j] = chunk.vertices[j];
+        for (int j = 0; j < chunk.triangles.count(); j++)
+            chunkTriangles[j] = chunk.triangles[j];
+        for (int j = 0; j < chunk.quads.count(); j++)
+            chunkQuads[j] = chunk.quads[j];
+
+        // second pass for relative indices, now that the number of vertices before this chunk is known
+        foreach (int corner, chunk.relativeTriangleCorners)
+            triangleCorner(chunkTriangles[corner / 3], corner % 3).index += vertexOffsets[i];
+        foreach (int corner, chunk.relativeQuadCorners)
+            quadCorner(chunkQuads[corner / 4], corner % 4).index += vertexOffsets[i];
+    }
+}
+
+void OBJParser::run(Mesh &mesh, Vector3 &minVertex, Vector3 &maxVertex)
+{
+    int numChunks = chunks.count();
+    parallelFor(numChunks, this, &OBJParser::parseChunks, 1);
+
+    // a single chunk is already the whole mesh
+    if (numChunks == 1)
+    {
+        OBJContents &chunk = chunks[0];
+        mesh.vertices = chunk.vertices;
+        mesh.triangles = chunk.triangles;
+        mesh.quads = chunk.quads;
+        mesh.balls = chunk.balls;
+        minVertex = chunk.minVertex;
+        maxVertex = chunk.maxVertex;
+        return;
+    }
+
+    vertexOffsets.resize(numChunks + 1);
+    triangleOffsets.resize(numChunks + 1);
+    quadOffsets.resize(numChunks + 1);
+    mesh.balls.clear();
+    for (int i = 0; i < numChunks; i++)
+    {
+        const OBJContents &chunk = chunks[i];
+        vertexOffsets[i + 1] = vertexOffsets[i] + chunk.vertices.count();
+        triangleOffsets[i + 1] = triangleOffsets[i] + chunk.triangles.count();
+        quadOffsets[i + 1] = quadOffsets[i] + chunk.quads.count();
+        mesh.balls += chunk.balls;
+        minVertex = Vector3::min(minVertex, chunk.minVertex);
+        maxVertex = Vector3::max(maxVertex, chunk.maxVertex);
+    }
+
+    mesh.vertices.resize(vertexOffsets[numChunks]);
+    mesh.triangles.resize(triangleOffsets[numChunks]);
+    mesh.quads.resize(quadOffsets[numChunks]);
+    vertices = mesh.vertices.data();
+    triangles = mesh.triangles.data();
+    quads = mesh.quads.data();
+    parallelFor(numChunks, this, &OBJParser::copyChunks, 1);
+}
+
+bool Mesh::loadFromOBJ(const string &file)
+{
+    PROFILE_SCOPE("Mesh::loadFromOBJ");
+    QFile f(QFile::decodeName(file.c_str()));
+    if (!f.open(QFile::ReadOnly)) return false;
+
+    // parse straight from the page cache when possible
+    QByteArray buffer;
+    const char *data = (const char *)f.map(0, f.size());
+    qint64 size = f.size();
+    if (!data)
+    {
+        buffer = f.readAll();
+        data = buffer.constData();
+        size = buffer.size();
+    }
+
+    Vector3 minVertex(FLT_MAX, FLT_MAX, FLT_MAX);
+    Vector3 maxVertex(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    OBJParser parser(data, size);
+    parser.run(*this, minVertex, maxVertex);
+    f.close();
 
     // scale the model to fit in a 4x4x4 cube
     // don't do this if there are any balls, because otherwise the skeleton would be misaligned
@@ -107,23 +430,25 @@ bool Mesh::loadFromOBJ(const string &file)
         }
     }
 
-    // remove bad triangles
-    for (int i = 0; i < triangles.size(); i++)
+    // remove bad triangles and quads, keeping the order of the rest
+    unsigned int numVertices = vertices.count();
+    int count = 0;
+    for (int i = 0; i < triangles.count(); i++)
     {
-        Triangle &tri = triangles[i];
-        if (tri.a.index < 0 || tri.b.index < 0 || tri.c.index < 0 ||
-                tri.a.index >= vertices.count() || tri.b.index >= vertices.count() || tri.c.index >= vertices.count())
-            triangles.remove(i--);
+        const Triangle &tri = triangles[i];
+        if ((unsigned int)tri.a.index < numVertices && (unsigned int)tri.b.index < numVertices && (unsigned int)tri.c.index < numVertices)
+            triangles[count++] = tri;
     }
-
-    // remove bad quads
-    for (int i = 0; i < quads.size(); i++)
+    triangles.resize(count);
+    count = 0;
+    for (int i = 0; i < quads.count(); i++)
     {
-        Quad &quad = quads[i];
-        if (quad.a.index < 0 || quad.b.index < 0 || quad.c.index < 0 || quad.d.index < 0 ||
-                quad.a.index >= vertices.count() || quad.b.index >= vertices.count() || quad.c.index >= vertices.count() || quad.d.index >= vertices.count())
-            quads.remove(i--);
+        const Quad &quad = quads[i];
+        if ((unsigned int)quad.a.index < numVertices && (unsigned int)quad.b.index < numVertices &&
+                (unsigned int)quad.c.index < numVertices && (unsigned int)quad.d.index < numVertices)
+            quads[count++] = quad;
     }
+    quads.resize(count);
 
     // remove bad balls
     for (int i = 0; i < balls.size(); i++)
@@ -151,28 +476,227 @@ bool Mesh::loadFromOBJ(const string &file)
     return true;
 }
 
-bool Mesh::saveToOBJ(const string &file)
+// Writes value with the fewest significant digits that still read back as
+// the same float, in the style of printf("%g"). Returns the end of the text.
+static char *formatFloat(char *out, float value)
+{
+    if (value != value || value - value != 0)
+        return out + sprintf(out, "%g", value);
+    if (value < 0 || (value == 0 && 1 / value < 0)) *out++ = '-';
+    double x = fabs((double)value);
+    if (x == 0)
+    {
+        *out++ = '0';
+        return out;
+    }
+
+    // find the shortest mantissa that rounds back to the same float, where
+    // both directions are a single correctly rounded operation on exact
+    // doubles like in parseFloat()
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    bool found = false;
+    int firstDigit = (int)floor(log10(x));
+    for (int numDigits = 1; numDigits <= 9 && !found; numDigits++)
+    {
+        int shift = numDigits - 1 - firstDigit;
+        if (shift < -22 || shift > 22) break;
+        double scaled = floor((shift >= 0 ? x * powersOfTen[shift] : x / powersOfTen[-shift]) + 0.5);
+        double back = shift >= 0 ? scaled / powersOfTen[shift] : scaled * powersOfTen[-shift];
+        if ((float)back == (float)x)
+        {
+            mantissa = (unsigned long long)scaled;
+            exponent = -shift;
+            found = true;
+        }
+    }
+
+    // very large or small numbers, nine digits are always enough for a float
+    if (!found)
+        return out + sprintf(out, "%.9g", x);
+
+    while (mantissa % 10 == 0)
+    {
+        mantissa /= 10;
+        exponent++;
+    }
+    char digits[24];
+    int numDigits = 0;
+    for (; mantissa; mantissa /= 10)
+        digits[numDigits++] = '0' + mantissa % 10;
+    int decimalExponent = exponent + numDigits - 1;
+
+    if (decimalExponent < -4 || decimalExponent >= 9)
+    {
+        // d.ddde+XX
+        *out++ = digits[--numDigits];
+        if (numDigits) *out++ = '.';
+        while (numDigits) *out++ = digits[--numDigits];
+        *out++ = 'e';
+        *out++ = decimalExponent < 0 ? '-' : '+';
+        int e = abs(decimalExponent);
+        if (e >= 100) *out++ = '0' + e / 100;
+        *out++ = '0' + e / 10 % 10;
+        *out++ = '0' + e % 10;
+    }
+    else if (exponent >= 0)
+    {
+        while (numDigits) *out++ = digits[--numDigits];
+        for (int i = 0; i < exponent; i++) *out++ = '0';
+    }
+    else if (decimalExponent >= 0)
+    {
+        for (int i = 0; i <= decimalExponent; i++) *out++ = digits[--numDigits];
+        *out++ = '.';
+        while (numDigits) *out++ = digits[--numDigits];
+    }
+    else
+    {
+        *out++ = '0';
+        *out++ = '.';
+        for (int i = -1; i > decimalExponent; i--) *out++ = '0';
+        while (numDigits) *out++ = digits[--numDigits];
+    }
+    return out;
+}
+
+static char *formatInt(char *out, int value)
+{
+    char digits[12];
+    int numDigits = 0;
+    unsigned int x = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    do digits[numDigits++] = '0' + x % 10; while (x /= 10);
+    if (value < 0) *out++ = '-';
+    while (numDigits) *out++ = digits[--numDigits];
+    return out;
+}
+
+static char *formatVector(char *out, const Vector3 &v)
+{
+    *out++ = ' ';
+    out = formatFloat(out, v.x);
+    *out++ = ' ';
+    out = formatFloat(out, v.y);
+    *out++ = ' ';
+    return formatFloat(out, v.z);
+}
+
+static char *formatIndex(char *out, const Index &index)
+{
+    *out++ = ' ';
+    return formatInt(out, index.index + 1);
+}
+
+// the longest line formatLine() can write ("j" lines are about 210 bytes)
+#define MAX_OBJ_LINE 256
+
+// lines per block, and the blocks are written in rounds of a few per thread
+#define OBJ_WRITE_BLOCK 16384
+
+// Formats the lines of the file in blocks, a round of blocks at a time on
+// the global QThreadPool (see parallel.h), and writes each round in order
+class OBJWriter
 {
-    ofstream f(file.c_str());
-    if (!f.good()) return false;
+public:
+    OBJWriter(const Mesh &mesh) : mesh(mesh), firstBlock(0) {}
+    bool run(QFile &f);
+    void formatBlocks(int begin, int end);
 
-    foreach (const Vertex &vertex, vertices)
-        f << "v " << vertex.pos.x << " " << vertex.pos.y << " " << vertex.pos.z << endl;
+private:
+    const Mesh &mesh;
+    int firstBlock;
+    QVector<QByteArray> buffers;
+    QVector<int> sizes;
 
-    foreach (const Triangle &tri, triangles)
-        f << "f " << (tri.a.index + 1) << " " << (tri.b.index + 1) << " " << (tri.c.index + 1) << endl;
+    char *formatLine(char *out, int line);
+};
 
-    foreach (const Quad &quad, quads)
-        f << "f " << (quad.a.index + 1) << " " << (quad.b.index + 1) << " " << (quad.c.index + 1) << " " << (quad.d.index + 1) << endl;
+char *OBJWriter::formatLine(char *out, int line)
+{
+    if (line < mesh.vertices.count())
+    {
+        *out++ = 'v';
+        out = formatVector(out, mesh.vertices[line].pos);
+    }
+    else if ((line -= mesh.vertices.count()) < mesh.triangles.count())
+    {
+        const Triangle &tri = mesh.triangles[line];
+        *out++ = 'f';
+        out = formatIndex(out, tri.a);
+        out = formatIndex(out, tri.b);
+        out = formatIndex(out, tri.c);
+    }
+    else if ((line -= mesh.triangles.count()) < mesh.quads.count())
+    {
+        const Quad &quad = mesh.quads[line];
+        *out++ = 'f';
+        out = formatIndex(out, quad.a);
+        out = formatIndex(out, quad.b);
+        out = formatIndex(out, quad.c);
+        out = formatIndex(out, quad.d);
+    }
+    else
+    {
+        const Ball &ball = mesh.balls[line - mesh.quads.count()];
+        *out++ = 'j';
+        out = formatVector(out, ball.center);
+        out = formatVector(out, ball.ex);
+        out = formatVector(out, ball.ey);
+        out = formatVector(out, ball.ez);
+        *out++ = ' ';
+        out = formatInt(out, ball.parentIndex + 1);
+    }
+    *out++ = '\n';
+    return out;
+}
 
-    foreach (const Ball &ball, balls)
+void OBJWriter::formatBlocks(int begin, int end)
+{
+    int numLines = mesh.vertices.count() + mesh.triangles.count() + mesh.quads.count() + mesh.balls.count();
+    for (int i = begin; i < end; i++)
     {
-        f << "j " << ball.center.x << " " << ball.center.y << " " << ball.center.z;
-        f << " " << ball.ex.x << " " << ball.ex.y << " " << ball.ex.z;
-        f << " " << ball.ey.x << " " << ball.ey.y << " " << ball.ey.z;
-        f << " " << ball.ez.x << " " << ball.ez.y << " " << ball.ez.z;
-        f << " " << (ball.parentIndex + 1) << endl;
+        QByteArray &buffer = buffers[i];
+        int used = 0;
+        int firstLine = (firstBlock + i) * OBJ_WRITE_BLOCK;
+        int lastLine = qMin(firstLine + OBJ_WRITE_BLOCK, numLines);
+        for (int line = firstLine; line < lastLine; line++)
+        {
+            if (buffer.size() - used < MAX_OBJ_LINE)
+                buffer.resize(qMax(buffer.size() * 2, used + MAX_OBJ_LINE));
+            used = formatLine(buffer.data() + used, line) - buffer.constData();
+        }
+        sizes[i] = used;
     }
+}
+
+bool OBJWriter::run(QFile &f)
+{
+    int numLines = mesh.vertices.count() + mesh.triangles.count() + mesh.quads.count() + mesh.balls.count();
+    int numBlocks = (numLines + OBJ_WRITE_BLOCK - 1) / OBJ_WRITE_BLOCK;
+    int blocksPerRound = qMax(1, QThreadPool::globalInstance()->maxThreadCount() * 4);
+    buffers.resize(qMin(blocksPerRound, numBlocks));
+    sizes.resize(buffers.count());
 
+    for (firstBlock = 0; firstBlock < numBlocks; firstBlock += blocksPerRound)
+    {
+        int count = qMin(blocksPerRound, numBlocks - firstBlock);
+        parallelFor(count, this, &OBJWriter::formatBlocks, 1);
+        for (int i = 0; i < count; i++)
+            if (f.write(buffers[i].constData(), sizes[i]) != sizes[i])
+                return false;
+    }
     return true;
 }
+
+bool Mesh::saveToOBJ(const string &file)
+{
+    PROFILE_SCOPE("Mesh::saveToOBJ");
+    QFile f(QFile::decodeName(file.c_str()));
+    if (!f.open(QFile::WriteOnly)) return false;
+
+    // the last block can still be in QFile's buffer, and a full disk only shows up when it's flushed
+    OBJWriter writer(*this);
+    bool written = writer.run(f) && f.flush() && f.error() == QFile::NoError;
+    f.close();
+    return written && f.error() == QFile::NoError;
+}
@@ -222,4 +222,5 @@ void JointRotationTool::updateVertices()
         updateBallCenter(i);
 
     view->doc->mesh.updateNormals();
+    view->meshChanged();
 }
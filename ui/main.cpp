@@ -1,5 +1,6 @@
 #include <QtGui/QApplication>
 #include "mainwindow.h"
+#include "profiler.h"
 
 int main(int argc, char *argv[])
 {
@@ -7,5 +8,9 @@ int main(int argc, char *argv[])
     MainWindow w;
     w.show();
 
-    return a.exec();
+    int result = a.exec();
+#ifdef ENABLE_PROFILER
+    Profiler::writeTrace("trace.json");
+#endif
+    return result;
 }
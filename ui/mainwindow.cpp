@@ -3,11 +3,13 @@
 #include "ui_mainwindow.h"
 #include "meshconstruction.h"
 #include "catmullclark.h"
+#include "adaptivesubdivision.h"
 #include "meshevolution.h"
 #include "convexhull3d.h"
 #include "edgefairing.h"
 #include "trianglestoquads.h"
 #include "meshsculpter.h"
+#include "profiler.h"
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QSettings>
@@ -191,6 +193,7 @@ void MainWindow::documentChanged()
 
 void MainWindow::runEverything()
 {
+    PROFILE_SCOPE("MainWindow::runEverything");
     Mesh mesh;
     Document &doc = ui->view->getDocument();
     mesh.balls = doc.mesh.balls;
@@ -236,6 +239,26 @@ void MainWindow::subdivideMesh()
     updateMode();
 }
 
+void MainWindow::adaptiveSubdivideMesh()
+{
+    Mesh mesh;
+    Document &doc = ui->view->getDocument();
+
+    // one level, only where the surface bends or faces look big from the current view
+    AdaptiveSubdivision adaptive;
+    adaptive.maxScreenSize = 16;
+    adaptive.setView(ui->view->getCamera().eye, FIELD_OF_VIEW, ui->view->height());
+    QVector<bool> refine;
+    adaptive.markFaces(doc.mesh, refine);
+    CatmullMesh::subdivide(doc.mesh, mesh, refine);
+
+    doc.getUndoStack().beginMacro("Adaptive Subdivide Mesh");
+    doc.changeMesh(doc.mesh.balls, mesh.vertices, mesh.triangles, mesh.quads);
+    doc.mesh.subdivisionLevel += 1;
+    doc.getUndoStack().endMacro();
+    updateMode();
+}
+
 void MainWindow::convexHull()
 {
     Mesh mesh;
@@ -252,7 +275,7 @@ void MainWindow::evolveMesh()
 {
     Document &doc = ui->view->getDocument();
     Mesh mesh = doc.mesh;
-    MeshEvolution::run(mesh);
+    MeshEvolution::runToConvergence(mesh);
     doc.getUndoStack().beginMacro("Evolve Mesh");
     doc.changeMesh(doc.mesh.balls, mesh.vertices, mesh.triangles, mesh.quads);
     doc.getUndoStack().endMacro();
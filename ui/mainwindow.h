@@ -31,6 +31,7 @@ public slots:
     void runEverything();
     void generateMesh();
     void subdivideMesh();
+    void adaptiveSubdivideMesh();
     void convexHull();
     void evolveMesh();
     void edgeFairing();
@@ -1,5 +1,6 @@
 #include "meshsculpter.h"
 #include "view.h"
+#include "profiler.h"
 #include <QMouseEvent>
 
 const float VOXEL_SPACING = 0.3f;
@@ -57,6 +58,7 @@ void MeshSculpterTool::getVerticesInSphere(const Vector3 &center, float radius,
 
 void MeshSculpterTool::stampBrush(const Vector3 &brushCenter, const Vector3 &brushNormal)
 {
+    PROFILE_SCOPE("MeshSculpterTool::stampBrush");
     QSet<MetaVertex *> brushVertices;
     getVerticesInSphere(brushCenter, brushRadius, brushVertices);
 
@@ -232,6 +234,8 @@ void MeshSculpterTool::moveSnake(int x, int y)
 
 void MeshSculpterTool::commitChanges(QSet<Quad *> &quadsNeedingNormals)
 {
+    PROFILE_SCOPE("MeshSculpterTool::commitChanges");
+    PROFILE_COUNTER("quads needing normals", quadsNeedingNormals.count());
     // Update the normals for all vertices touching a moved quad
     QSet<MetaVertex *> verticesNeedingNormals;
     foreach (Quad *quad, quadsNeedingNormals)
@@ -264,11 +268,14 @@ void MeshSculpterTool::commitChanges(QSet<Quad *> &quadsNeedingNormals)
         if (verticesNeedingNormals.contains(c)) c->normal += normal;
         if (verticesNeedingNormals.contains(d)) d->normal += normal;
     }
+    QVector<int> changedIndices;
     foreach (MetaVertex *vertex, verticesNeedingNormals)
     {
         vertex->normal.normalize();
         verticesToCommit += vertex;
+        changedIndices += vertex->index;
     }
+    view->meshVerticesMoved(changedIndices);
 
     // Commit the result to the GPU
     mesh->mesh.uploadToGPU();
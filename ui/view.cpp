@@ -3,6 +3,7 @@
 #include "curvature.h"
 #include "meshsculpter.h"
 #include "jointrotation.h"
+#include "profiler.h"
 #include <QWheelEvent>
 
 #define PLANE_SIZE 10
@@ -13,10 +14,12 @@ View::View(QWidget *parent) : QGLWidget(parent), doc(new Document), selectedBall
 #ifdef USE_SHADER_MATERIALS
     currentMaterial(0),
 #endif
-    mirrorChanges(false), drawWireframe(true), drawInterpolated(true), drawCurvature(false),
+    mirrorChanges(false), drawWireframe(true), drawInterpolated(true), drawCurvature(false), curvatureIsCurrent(false),
     brushMode(BRUSH_ADD_OR_SUBTRACT), brushRadius(0), brushWeight(0), brushTool(NULL),
     currentCamera(&firstPersonCamera), drawToolDebug(false), currentTool(NULL)
 {
+    connect(doc, SIGNAL(topologyChanged()), this, SLOT(meshChanged()));
+    connect(doc, SIGNAL(verticesChanged(QVector<int>)), this, SLOT(meshVerticesMoved(QVector<int>)));
     resetCamera();
     setMouseTracking(true);
 }
@@ -84,6 +87,9 @@ void View::setDocument(Document *newDoc)
 {
     delete doc;
     doc = newDoc;
+    connect(doc, SIGNAL(topologyChanged()), this, SLOT(meshChanged()));
+    connect(doc, SIGNAL(verticesChanged(QVector<int>)), this, SLOT(meshVerticesMoved(QVector<int>)));
+    meshChanged();
     resetCamera();
     resetInteraction();
     update();
@@ -150,6 +156,7 @@ void View::resizeGL(int width, int height)
 
 void View::paintGL()
 {
+    PROFILE_SCOPE("View::paintGL");
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     camera3D();
 
@@ -191,11 +198,13 @@ void View::paintGL()
 #else
         drawMesh(true);
 #endif
+        if (drawCurvature) drawCurvatureOverlay();
         drawGroundPlane();
     }
     else if (mode == MODE_VIEW_MESH || mode == MODE_ANIMATE_MESH)
     {
         drawMesh(false);
+        if (drawCurvature) drawCurvatureOverlay();
         drawGroundPlane();
         drawSkeleton(true);
     }
@@ -208,8 +217,32 @@ void View::paintGL()
     if (drawToolDebug)
         foreach (Tool *tool, tools)
             tool->drawDebug(mouseX, mouseY);
+
+#ifdef ENABLE_PROFILER
+    drawProfilerOverlay();
+#endif
 }
 
+#ifdef ENABLE_PROFILER
+void View::drawProfilerOverlay()
+{
+    // the paintGL row is for the previous frame since this one isn't done yet
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glColor3f(0, 0, 0);
+    QFont font("Courier", 10);
+    int y = 15;
+    renderText(10, y, QString("%1 %2 %3 %4").arg("stage", -32).arg("last ms", 10).arg("allocs", 9).arg("peak", 9), font);
+    foreach (const ProfileStat &stat, Profiler::stats())
+    {
+        y += 15;
+        renderText(10, y, QString("%1 %2 %3 %4").arg(stat.name, -32).arg(stat.lastMilliseconds, 10, 'f', 2)
+            .arg(stat.lastAllocations, 9).arg(stat.peakAllocations, 9), font);
+    }
+    glEnable(GL_DEPTH_TEST);
+}
+#endif
+
 void View::mousePressEvent(QMouseEvent *event)
 {
     mouseX = event->x();
@@ -364,18 +397,25 @@ void View::drawMesh(bool justMesh) const
         glDisable(GL_BLEND);
         glDepthMask(GL_TRUE);
     }
+}
 
-    if (drawCurvature)
-    {
-        glDepthMask(GL_FALSE);
-        glEnable(GL_BLEND);
+void View::drawCurvatureOverlay()
+{
+    if (doc->mesh.triangles.count() + doc->mesh.quads.count() == 0) return;
 
-        glColor4f(0, 0, 0, 0.5);
-        Curvature().drawCurvatures(doc->mesh);
+    if (!curvatureIsCurrent) curvature.computeCurvatures(doc->mesh);
+    else if (!curvatureChanges.isEmpty()) curvature.updateCurvatures(doc->mesh, curvatureChanges);
+    curvatureIsCurrent = true;
+    curvatureChanges.clear();
 
-        glDisable(GL_BLEND);
-        glDepthMask(GL_TRUE);
-    }
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+
+    glColor4f(0, 0, 0, 0.5);
+    curvature.drawCurvatures(doc->mesh);
+
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
 }
 
 void View::drawSkeleton(bool drawTransparent) const
@@ -568,7 +608,7 @@ void View::camera3D() const
 {
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(45, (float)width() / (float)height(), 0.1, 5000.0);
+    gluPerspective(FIELD_OF_VIEW, (float)width() / (float)height(), 0.1, 5000.0);
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
     currentCamera->apply();
@@ -594,9 +634,22 @@ void View::setInterpolated(bool useInterpolated)
 
 void View::setCurvature(bool useCurvature) {
     drawCurvature = useCurvature;
+    meshChanged();
     update();
 }
 
+void View::meshChanged()
+{
+    curvatureIsCurrent = false;
+    curvatureChanges.clear();
+}
+
+void View::meshVerticesMoved(const QVector<int> &vertexIndices)
+{
+    // nothing to keep up to date otherwise
+    if (drawCurvature && curvatureIsCurrent) curvatureChanges += vertexIndices;
+}
+
 void View::setDrawToolDebug(bool drawDebug)
 {
     drawToolDebug = drawDebug;
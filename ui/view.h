@@ -26,6 +26,9 @@ enum
 
 class MeshSculpterTool;
 
+// vertical field of view of the 3D camera in degrees
+#define FIELD_OF_VIEW 45
+
 enum
 {
     MATERIAL_CURVATURE,
@@ -52,6 +55,7 @@ public:
     void setCamera(int camera);
     void setDocument(Document *doc);
     Document &getDocument() { return *doc; }
+    const Camera &getCamera() const { return *currentCamera; }
 
     void undo();
     void redo();
@@ -86,6 +90,12 @@ private:
     bool drawInterpolated;
     bool drawCurvature;
 
+    // the curvature overlay is recomputed from scratch when the topology
+    // changes, and only around the moved vertices otherwise
+    Curvature curvature;
+    bool curvatureIsCurrent;
+    QVector<int> curvatureChanges;
+
     int brushMode;
     float brushRadius;
     float brushWeight;
@@ -114,17 +124,28 @@ private:
     void resetCamera();
     void resetInteraction();
     void drawMesh(bool justMesh) const;
+    void drawCurvatureOverlay();
     void drawSkeleton(bool drawTransparent) const;
     void drawGroundPlane() const;
     void drawFullscreenQuad() const;
     void camera2D() const;
     void camera3D() const;
+#ifdef ENABLE_PROFILER
+    void drawProfilerOverlay();
+#endif
 
 public slots:
     void setMirrorChanges(bool useMirrorChanges);
     void setWireframe(bool useWireframe);
     void setInterpolated(bool useInterpolated);
     void setCurvature(bool useCurvature);
+    void meshChanged();
+
+    // moved vertices, from Document::verticesChanged() and from tools that
+    // move them before committing, so the curvature overlay only
+    // recomputes what changed
+    void meshVerticesMoved(const QVector<int> &vertexIndices);
+
     void setDrawToolDebug(bool drawDebug);
     void deleteSelection();
 };
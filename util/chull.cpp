@@ -5,80 +5,61 @@
 #include "chull.h"
 
 #define SWAP(t,x,y) { t = x; x = y; y = t; }
-#define ADD( head, p )  if ( head )  { \
-                                p->next = head; \
-                                p->prev = head->prev; \
-                                head->prev = p; \
-                                p->prev->next = p; \
+#define ADD( pool, head, p )  if ( head != CHULL3D_NONE )  { \
+                                pool[p].next = head; \
+                                pool[p].prev = pool[head].prev; \
+                                pool[head].prev = p; \
+                                pool[pool[p].prev].next = p; \
                         } \
                         else { \
                                 head = p; \
-                                head->next = head->prev = p; \
+                                pool[p].next = pool[p].prev = p; \
                         }
 
-#define DELETE( head, p ) if ( head )  { \
-                                if ( head == head->next ) \
-                                        head = NULL;  \
+#define DELETE( pool, head, p ) if ( head != CHULL3D_NONE )  { \
+                                if ( head == pool[head].next ) \
+                                        head = CHULL3D_NONE;  \
                                 else if ( p == head ) \
-                                        head = head->next; \
-                                p->next->prev = p->prev;  \
-                                p->prev->next = p->next; \
-                                delete p; \
+                                        head = pool[head].next; \
+                                pool[pool[p].next].prev = pool[p].prev;  \
+                                pool[pool[p].prev].next = pool[p].next; \
                         }
 
-Chull3D::Chull3D (float *v, int n)
+Chull3D::Chull3D (const float *v, int n)
 {
   int i;
-  assert (v);
-
-  /* init vertices */
-  vertices = NULL;
+  assert (v || !n);
+
+  /* a hull of n points has at most 2n-4 faces and 3n-6 edges, and
+     each insertion adds a few more before the visible ones are freed */
+  edge_pool.reserve (3*n + 16);
+  face_pool.reserve (2*n + 16);
+
+  /* init vertices, stored at the same index as the input. only the
+     vertices of the hull built so far are linked into the list, so
+     the clean up after each insertion doesn't walk the whole input */
+  vertex_pool.resize (n);
+  vertices = edges = faces = CHULL3D_NONE;
+  first = 0;
   for (i=0; i<n; i++)
-    add_vertex (new Chull3D_vertex (v[3*i], v[3*i+1], v[3*i+2]));
-  edges = NULL;
-  faces = NULL;
-}
-
-Chull3D::~Chull3D ()
-{
-  Chull3D_vertex *v, *vt;
-  Chull3D_edge *e, *et;
-  Chull3D_face *f, *ft;
-
-  // clean vertices
-  v = vertices;
-  do {
-          vt = v;
-          v = v->next;
-          delete_vertex (vt);
-  } while (vertices->next != vertices);
-  delete_vertex (vertices);
-
-  // clean edges
-  e = edges;
-  do {
-          et = e;
-          e = e->next;
-          delete_edge (et);
-  } while (edges->next != edges);
-  delete_edge (edges);
-
-  // clean faces
-  f = faces;
-  do {
-          ft = f;
-          f = f->next;
-          delete_face (ft);
-  } while (faces->next != faces);
-  delete_face (faces);
+    {
+      Chull3D_vertex &vertex = vertex_pool[i];
+      vertex.pt[0] = v[3*i];
+      vertex.pt[1] = v[3*i+1];
+      vertex.pt[2] = v[3*i+2];
+      vertex.duplicate = CHULL3D_NONE;
+      vertex.on_hull   = 0;
+      vertex.processed = 0;
+      vertex.prev = vertex.next = CHULL3D_NONE;
+    }
 }
 
-void Chull3D::add_vertex    (Chull3D_vertex *v) { ADD (vertices, v); }
-void Chull3D::add_edge      (Chull3D_edge *e)   { ADD (edges, e); }
-void Chull3D::add_face      (Chull3D_face *f)   { ADD (faces, f); }
-void Chull3D::delete_vertex (Chull3D_vertex *v) { DELETE (vertices, v); }
-void Chull3D::delete_edge   (Chull3D_edge *e)   { DELETE (edges, e); }
-void Chull3D::delete_face   (Chull3D_face *f)   { DELETE (faces, f); }
+void Chull3D::add_vertex    (int v) { ADD (vertex_pool, vertices, v); }
+void Chull3D::add_edge      (int e) { ADD (edge_pool, edges, e); }
+void Chull3D::add_face      (int f) { ADD (face_pool, faces, f); }
+void Chull3D::delete_vertex (int v) { DELETE (vertex_pool, vertices, v); }
+void Chull3D::delete_edge   (int e) { DELETE (edge_pool, edges, e); edge_pool.release (e); }
+void Chull3D::delete_face   (int f) { DELETE (face_pool, faces, f); face_pool.release (f); }
 
 /**********/
 /* output */
@@ -86,41 +67,27 @@ void Chull3D::delete_face   (Chull3D_face *f)   { DELETE (faces, f); }
 int
 Chull3D::get_n_vertices (void)
 {
-  Chull3D_vertex *v = vertices;
+  int v = vertices;
   int n=0;
-  if (!vertices)
+  if (vertices == CHULL3D_NONE)
     return 0;
   else
-    do { v = v->next; n++; } while (v != vertices);
+    do { v = vertex_pool[v].next; n++; } while (v != vertices);
   return n;
 }
 
 int
 Chull3D::get_n_faces (void)
 {
-  Chull3D_face *f = faces;
+  int f = faces;
   int n=0;
-  if (!faces)
+  if (faces == CHULL3D_NONE)
     return 0;
   else
-    do { f = f->next; n++; } while (f != faces);
+    do { f = face_pool[f].next; n++; } while (f != faces);
   return n;
 }
 
-int
-Chull3D::get_vertex_index (Chull3D_vertex *v)
-{
-  Chull3D_vertex *v_walk = vertices;
-  int index = 0;
-  do {
-    if (v_walk == v)
-      return index;
-    index++;
-    v_walk = v_walk->next;
-  } while (v_walk != vertices);
-  return -1;
-}
-
 int
 Chull3D::get_convex_hull (float **v, int *nv, int **f, int *nf)
 {
@@ -132,32 +99,39 @@ Chull3D::get_convex_hull (float **v, int *nv, int **f, int *nf)
   int   *cv_faces    = (int*)malloc(3*(*nf)*sizeof(int));
   if (!cv_vertices || !cv_faces)
     {
-      v = NULL; f = NULL;
+      free (cv_vertices); free (cv_faces);
+      *v = NULL; *f = NULL;
       *nv = *nf = 0;
       return 0;
     }
 
-  /* vertices */
-  Chull3D_vertex *v_walk=vertices;
+  /* vertices, remembering where each one went */
+  QVector<int> index (vertex_pool.size (), -1);
+  int v_walk = vertices;
   int i=0;
-  do {
-    cv_vertices[3*i]   = v_walk->pt[0];
-    cv_vertices[3*i+1] = v_walk->pt[1];
-    cv_vertices[3*i+2] = v_walk->pt[2];
-    v_walk = v_walk->next;
-    i++;
-  } while (v_walk != vertices);
+  if (v_walk != CHULL3D_NONE)
+    do {
+      const Chull3D_vertex &vertex = vertex_pool[v_walk];
+      cv_vertices[3*i]   = vertex.pt[0];
+      cv_vertices[3*i+1] = vertex.pt[1];
+      cv_vertices[3*i+2] = vertex.pt[2];
+      index[v_walk] = i;
+      v_walk = vertex.next;
+      i++;
+    } while (v_walk != vertices);
 
   /* faces */
   i = 0;
-  Chull3D_face *f_walk = faces;
-  do {
-    cv_faces[3*i]   = get_vertex_index (f_walk->vertices[0]);
-    cv_faces[3*i+1] = get_vertex_index (f_walk->vertices[1]);
-    cv_faces[3*i+2] = get_vertex_index (f_walk->vertices[2]);
-    f_walk = f_walk->next;
-    i++;
-  } while (f_walk != faces);
+  int f_walk = faces;
+  if (f_walk != CHULL3D_NONE)
+    do {
+      const Chull3D_face &face = face_pool[f_walk];
+      cv_faces[3*i]   = index[face.vertices[0]];
+      cv_faces[3*i+1] = index[face.vertices[1]];
+      cv_faces[3*i+2] = index[face.vertices[2]];
+      f_walk = face.next;
+      i++;
+    } while (f_walk != faces);
 
   *v = cv_vertices;
   *f = cv_faces;
@@ -172,85 +146,107 @@ Chull3D::export_mesh (Mesh &mesh)
   mesh.triangles.clear();
   mesh.quads.clear();
 
-  /* vertices */
-  Chull3D_vertex *v_walk = vertices;
-  do {
-    mesh.vertices += Vertex(Vector3(v_walk->pt[0], v_walk->pt[1], v_walk->pt[2]));
-    v_walk = v_walk->next;
-  } while (v_walk != vertices);
+  /* vertices, remembering where each one went */
+  QVector<int> index (vertex_pool.size (), -1);
+  int v_walk = vertices;
+  if (v_walk != CHULL3D_NONE)
+    do {
+      const Chull3D_vertex &vertex = vertex_pool[v_walk];
+      index[v_walk] = mesh.vertices.count();
+      mesh.vertices += Vertex(Vector3(vertex.pt[0], vertex.pt[1], vertex.pt[2]));
+      v_walk = vertex.next;
+    } while (v_walk != vertices);
 
   /* faces */
-  Chull3D_face *f_walk = faces;
-  do {
+  int f_walk = faces;
+  if (f_walk != CHULL3D_NONE)
+    do {
+      const Chull3D_face &face = face_pool[f_walk];
       mesh.triangles += Triangle(
-             get_vertex_index (f_walk->vertices[0]),
-             get_vertex_index (f_walk->vertices[1]),
-             get_vertex_index (f_walk->vertices[2]));
-    f_walk = f_walk->next;
-  } while (f_walk != faces);
+             index[face.vertices[0]],
+             index[face.vertices[1]],
+             index[face.vertices[2]]);
+      f_walk = face.next;
+    } while (f_walk != faces);
+}
+
+void
+Chull3D::export_triangles (QVector<Triangle> &triangles)
+{
+  /* vertex records are stored at their input index */
+  int f_walk = faces;
+  if (f_walk != CHULL3D_NONE)
+    do {
+      const Chull3D_face &face = face_pool[f_walk];
+      triangles += Triangle(face.vertices[0], face.vertices[1], face.vertices[2]);
+      f_walk = face.next;
+    } while (f_walk != faces);
 }
 
 /*****************/
 /*** Algorithm ***/
 /*****************/
-void
+int
 Chull3D::compute (void)
 {
-  double_triangle ();
-  construct_hull ();
+  if (vertex_pool.size () < 4 || double_triangle ())
+    {
+      /* leave no partial hull behind */
+      vertices = faces = edges = CHULL3D_NONE;
+      return 1;
+    }
+  return construct_hull ();
 }
 
 /* builds the initial double triangle */
 int
 Chull3D::double_triangle (void)
 {
-  Chull3D_vertex *v0, *v1, *v2, *v3;
+  int n = vertex_pool.size ();
+  int v0, v1, v2, v3;
   int vol;
 
-  /* find 3 non collinear points */
-  v0 = vertices;
-  while (are_collinear (v0, v0->next, v0->next->next))
-    if ( (v0=v0->next) == vertices)
-      {
-        printf ("All the vertices are collinear\n");
-        return 1;
-      }
-  v1 = v0->next;
-  v2 = v1->next;
+  /* find 3 non collinear points, treating the input as circular */
+  v0 = 0;
+  while (are_collinear (v0, (v0+1)%n, (v0+2)%n))
+    if ( ++v0 == n)
+      return 1;
+  v1 = (v0+1)%n;
+  v2 = (v1+1)%n;
 
   /* mark the vertices as processed */
-  v0->processed = 1;
-  v1->processed = 1;
-  v2->processed = 1;
+  vertex_pool[v0].processed = 1;
+  vertex_pool[v1].processed = 1;
+  vertex_pool[v2].processed = 1;
+  add_vertex (v0);
+  add_vertex (v1);
+  add_vertex (v2);
 
   /* create the two "twins" faces */
-  Chull3D_face *f0, *f1 = NULL;
-  f0 = new Chull3D_face (this, v0, v1, v2, f1);
-  f1 = new Chull3D_face (this, v2, v1, v0, f0);
+  int f0, f1;
+  f0 = new_face (v0, v1, v2, CHULL3D_NONE);
+  f1 = new_face (v2, v1, v0, f0);
 
   /* link adjacent face fields */
-  f0->edges[0]->adj_faces[1] = f1;
-  f0->edges[1]->adj_faces[1] = f1;
-  f0->edges[2]->adj_faces[1] = f1;
-  f1->edges[0]->adj_faces[1] = f0;
-  f1->edges[1]->adj_faces[1] = f0;
-  f1->edges[2]->adj_faces[1] = f0;
+  edge_pool[face_pool[f0].edges[0]].adj_faces[1] = f1;
+  edge_pool[face_pool[f0].edges[1]].adj_faces[1] = f1;
+  edge_pool[face_pool[f0].edges[2]].adj_faces[1] = f1;
+  edge_pool[face_pool[f1].edges[0]].adj_faces[1] = f0;
+  edge_pool[face_pool[f1].edges[1]].adj_faces[1] = f0;
+  edge_pool[face_pool[f1].edges[2]].adj_faces[1] = f0;
 
   /* find a fourth, non coplanar point to form tetrahedron */
-  v3 = v2->next;
+  v3 = (v2+1)%n;
   vol = volume_sign (f0, v3);
   while (!vol)
     {
-      if ( (v3=v3->next) == v0)
-        {
-          printf ("All the vertices are coplanar\n");
-          return 1;
-        }
+      if ( (v3=(v3+1)%n) == v0)
+        return 1;
       vol = volume_sign (f0, v3);
     }
 
   /* insure that v3 will be the first added */
-  vertices = v3;
+  first = v3;
 
   return 0;
 }
@@ -261,19 +257,23 @@ Chull3D::double_triangle (void)
 int
 Chull3D::construct_hull (void)
 {
-  Chull3D_vertex *v, *vnext;
+  int n = vertex_pool.size ();
+  int i, v;
 
-  v = vertices;
-  do {
-    vnext = v->next;
-    if (!v->processed)
-      {
-        v->processed = 1;
-        add_one (v);
-        clean_up (vnext);
-      }
-    v = vnext;
-  } while (v != vertices);
+  for (i=0; i<n; i++)
+    {
+      v = (first+i)%n;
+      if (!vertex_pool[v].processed)
+        {
+          vertex_pool[v].processed = 1;
+          /* points inside the hull change nothing */
+          if (add_one (v))
+            {
+              add_vertex (v);
+              clean_up ();
+            }
+        }
+    }
 
   return 0;
 }
@@ -284,15 +284,18 @@ Chull3D::construct_hull (void)
  * product is zero.
  */
 int
-Chull3D::are_collinear (Chull3D_vertex *v1, Chull3D_vertex *v2, Chull3D_vertex *v3)
+Chull3D::are_collinear (int i1, int i2, int i3)
 {
+  const float *p1 = vertex_pool[i1].pt;
+  const float *p2 = vertex_pool[i2].pt;
+  const float *p3 = vertex_pool[i3].pt;
   return
-    (( v3->pt[2] - v1->pt[2] ) * ( v2->pt[1] - v1->pt[1] ) -
-     ( v2->pt[2] - v1->pt[2] ) * ( v3->pt[1] - v1->pt[1] ) == 0
-     && ( v2->pt[2] - v1->pt[2] ) * ( v3->pt[0] - v1->pt[0] ) -
-     ( v2->pt[0] - v1->pt[0] ) * ( v3->pt[2] - v1->pt[2] ) == 0
-     && ( v2->pt[0] - v1->pt[0] ) * ( v3->pt[1] - v1->pt[1] ) -
-     ( v2->pt[1] - v1->pt[1] ) * ( v3->pt[0] - v1->pt[0] ) == 0);
+    (( p3[2] - p1[2] ) * ( p2[1] - p1[1] ) -
+     ( p2[2] - p1[2] ) * ( p3[1] - p1[1] ) == 0
+     && ( p2[2] - p1[2] ) * ( p3[0] - p1[0] ) -
+     ( p2[0] - p1[0] ) * ( p3[2] - p1[2] ) == 0
+     && ( p2[0] - p1[0] ) * ( p3[1] - p1[1] ) -
+     ( p2[1] - p1[1] ) * ( p3[0] - p1[0] ) == 0);
 }
 
 /*
@@ -302,22 +305,32 @@ Chull3D::are_collinear (Chull3D_vertex *v1, Chull3D_vertex *v2, Chull3D_vertex *
  * positive side is determined by the rh-rule. So the volume is
  * positive if the ccw normal to f points outside the tetrahedron.
  * The final fewer-multiplications form is due to Bob Williamson.
+ * Working in double makes the coordinate differences exact, but the
+ * products and sums are still rounded. That is much more precise than
+ * float for the tiny, nearly coplanar clusters at joints, but it is not
+ * an exact orientation test, so the sign can still be wrong very close
+ * to zero.
  */
 int
-Chull3D::volume_sign (Chull3D_face *f, Chull3D_vertex *v)
+Chull3D::volume_sign (int f, int v)
 {
-  float ax, ay, az, bx, by, bz, cx, cy, cz;
-  float vol;
-
-   ax = f->vertices[0]->pt[0] - v->pt[0];
-   ay = f->vertices[0]->pt[1] - v->pt[1];
-   az = f->vertices[0]->pt[2] - v->pt[2];
-   bx = f->vertices[1]->pt[0] - v->pt[0];
-   by = f->vertices[1]->pt[1] - v->pt[1];
-   bz = f->vertices[1]->pt[2] - v->pt[2];
-   cx = f->vertices[2]->pt[0] - v->pt[0];
-   cy = f->vertices[2]->pt[1] - v->pt[1];
-   cz = f->vertices[2]->pt[2] - v->pt[2];
+  double ax, ay, az, bx, by, bz, cx, cy, cz;
+  double vol;
+  const Chull3D_face &face = face_pool[f];
+  const float *p  = vertex_pool[v].pt;
+  const float *p0 = vertex_pool[face.vertices[0]].pt;
+  const float *p1 = vertex_pool[face.vertices[1]].pt;
+  const float *p2 = vertex_pool[face.vertices[2]].pt;
+
+   ax = (double)p0[0] - p[0];
+   ay = (double)p0[1] - p[1];
+   az = (double)p0[2] - p[2];
+   bx = (double)p1[0] - p[0];
+   by = (double)p1[1] - p[1];
+   bz = (double)p1[2] - p[2];
+   cx = (double)p2[0] - p[0];
+   cy = (double)p2[1] - p[1];
+   cz = (double)p2[2] - p[2];
 
    vol =   ax * (by*cz - bz*cy)
          + ay * (bz*cx - bx*cz)
@@ -336,10 +349,9 @@ Chull3D::volume_sign (Chull3D_face *f, Chull3D_vertex *v)
  * one of the adjacent faces is visible then a new face is constructed.
  */
 int
-Chull3D::add_one (Chull3D_vertex *v)
+Chull3D::add_one (int v)
 {
-  Chull3D_face *f;
-  Chull3D_edge *e, *temp;
+  int f, e, temp;
   int vol;
   int vis = 0;
 
@@ -349,32 +361,42 @@ Chull3D::add_one (Chull3D_vertex *v)
     vol = volume_sign (f, v);
     if (vol<0)
       {
-        f->visible = 1;
+        face_pool[f].visible = 1;
         vis = 1;
       }
-    f = f->next;
+    f = face_pool[f].next;
   } while (f != faces);
 
   /* if no faces are visible from v, then v is inside the hull */
   if (!vis)
     {
-      v->on_hull = 0;
+      vertex_pool[v].on_hull = 0;
       return 0;
     }
 
   /* mark edges in interior of visible region for deletion.
-     erect a new face based on each border edge */
+     erect a new face based on each border edge. new edges are
+     added at the end of the list, just before the old head, so
+     they are not visited by this loop */
   e = edges;
-  do {
-    temp = e->next;
-    if (e->adj_faces[0]->visible && e->adj_faces[1]->visible)
+  int last = edge_pool[edges].prev;
+  for (;;) {
+    temp = edge_pool[e].next;
+    int visible0 = face_pool[edge_pool[e].adj_faces[0]].visible;
+    int visible1 = face_pool[edge_pool[e].adj_faces[1]].visible;
+    if (visible0 && visible1)
       /* e interior: mark for deletion */
-      e->to_delete = 1;
-    else if (e->adj_faces[0]->visible || e->adj_faces[1]->visible)
-      /* e border: make a new face */
-      e->new_face = new Chull3D_face (this, e, v);
+      edge_pool[e].to_delete = 1;
+    else if (visible0 || visible1)
+      {
+        /* e border: make a new face */
+        int nf = new_cone_face (e, v);
+        edge_pool[e].new_face = nf;
+      }
+    if (e == last)
+      break;
     e = temp;
-  } while (e != edges);
+  }
 
   return 1;
 }
@@ -384,11 +406,11 @@ Chull3D::add_one (Chull3D_vertex *v)
  * and NULLs out some pointers.
  */
 void
-Chull3D::clean_up (Chull3D_vertex *vnext)
+Chull3D::clean_up (void)
 {
   clean_edges ();
   clean_faces ();
-  clean_vertices (vnext);
+  clean_vertices ();
 }
 
 /*
@@ -400,37 +422,35 @@ Chull3D::clean_up (Chull3D_vertex *vnext)
 void
 Chull3D::clean_edges (void)
 {
-  Chull3D_edge *e, *t;
+  int e, t;
 
   /* integrate the new face's into the data structure */
   /* check every edge */
   e = edges;
   do {
-      if (e->new_face)
+      Chull3D_edge &edge = edge_pool[e];
+      if (edge.new_face != CHULL3D_NONE)
         {
-          if (e->adj_faces[0]->visible) e->adj_faces[0] = e->new_face;
-          else                          e->adj_faces[1] = e->new_face;
-          e->new_face = NULL;
+          if (face_pool[edge.adj_faces[0]].visible) edge.adj_faces[0] = edge.new_face;
+          else                                      edge.adj_faces[1] = edge.new_face;
+          edge.new_face = CHULL3D_NONE;
         }
-      e = e->next;
+      e = edge.next;
   } while (e != edges);
 
   /* delete any edges marked for deletion */
-  while (edges && edges->to_delete)
-    {
-      e = edges;
-      delete_edge (e);
-    }
-  e = edges->next;
+  while (edges != CHULL3D_NONE && edge_pool[edges].to_delete)
+    delete_edge (edges);
+  e = edge_pool[edges].next;
   do {
-    if (e->to_delete)
+    if (edge_pool[e].to_delete)
       {
         t = e;
-        e = e->next;
+        e = edge_pool[e].next;
         delete_edge (t);
       }
     else
-      e = e->next;
+      e = edge_pool[e].next;
   } while (e != edges);
 }
 
@@ -440,174 +460,164 @@ Chull3D::clean_edges (void)
 void
 Chull3D::clean_faces (void)
 {
-  Chull3D_face *f, *t;
+  int f, t;
 
-  while (faces && faces->visible)
-    {
-      f = faces;
-      delete_face (f);
-    }
-  f = faces->next;
+  while (faces != CHULL3D_NONE && face_pool[faces].visible)
+    delete_face (faces);
+  f = face_pool[faces].next;
   do {
-    if (f->visible)
+    if (face_pool[f].visible)
       {
         t = f;
-        f = f->next;
+        f = face_pool[f].next;
         delete_face (t);
       }
     else
-      f = f->next;
+      f = face_pool[f].next;
   } while (f != faces);
 }
 
 /*
  * runs through the vertex list and deletes the vertice
- * that are marked as processed but are not incident to
- * any undeleted edges.
- * The pointer to vnext, pvnext, is used to alter vnext
- * in construct_hull() if we are about to delete vnext.
+ * that are not incident to any undeleted edges. the list
+ * only holds processed vertices.
 */
 void
-Chull3D::clean_vertices (Chull3D_vertex *vnext)
+Chull3D::clean_vertices (void)
 {
-  Chull3D_edge *e;
-  Chull3D_vertex *v, *t;
+  int e;
+  int v, t;
 
   /* mark all vertices incident to some undeleted edge as
      on the hull */
   e = edges;
   do {
-    e->end_points[0]->on_hull = e->end_points[1]->on_hull = 1;
-    e = e->next;
+    const Chull3D_edge &edge = edge_pool[e];
+    vertex_pool[edge.end_points[0]].on_hull = vertex_pool[edge.end_points[1]].on_hull = 1;
+    e = edge.next;
   } while (e != edges);
 
-  /* delete all vertices that have been processed but are
-     not on the hull */
-  while (vertices && vertices->processed && !vertices->on_hull)
-    {
-      /* if about to delete vnext, advance it first */
-      if (v == vnext)
-        vnext = v->next;
-        v = vertices;
-        delete_vertex (v);
-    }
-  v = vertices->next;
+  /* delete all vertices that are not on the hull */
+  while (vertices != CHULL3D_NONE && !vertex_pool[vertices].on_hull)
+    delete_vertex (vertices);
+  v = vertex_pool[vertices].next;
   do {
-    if (v->processed && !v->on_hull)
+    if (!vertex_pool[v].on_hull)
       {
         t = v;
-        v = v->next;
+        v = vertex_pool[v].next;
         delete_vertex (t);
       }
     else
-      v = v->next;
+      v = vertex_pool[v].next;
   } while (v != vertices);
 
   /* reset flags */
   v = vertices;
   do {
-      v->duplicate = NULL;
-      v->on_hull = 0;
-      v = v->next;
+      vertex_pool[v].duplicate = CHULL3D_NONE;
+      vertex_pool[v].on_hull = 0;
+      v = vertex_pool[v].next;
   } while (v != vertices);
 }
 
-/**********************/
-/*** Chull3D_vertex ***/
-/**********************/
-Chull3D_vertex::Chull3D_vertex (float x, float y, float z)
-{
-  pt[0] = x;  pt[1] = y;  pt[2] = z;
-  duplicate = NULL;
-  on_hull   = 0;
-  processed = 0;
-}
-
-/********************/
-/*** Chull3D_edge ***/
-/********************/
-Chull3D_edge::Chull3D_edge (Chull3D *hull3D)
+/***************/
+/*** Records ***/
+/***************/
+int
+Chull3D::new_edge (void)
 {
- adj_faces[0]  = adj_faces[1]  = new_face = NULL;
-  end_points[0] = end_points[1] = NULL;
-  to_delete = 0;
-  hull3D->add_edge (this);
+  int e = edge_pool.alloc ();
+  Chull3D_edge &edge = edge_pool[e];
+  edge.adj_faces[0]  = edge.adj_faces[1]  = edge.new_face = CHULL3D_NONE;
+  edge.end_points[0] = edge.end_points[1] = CHULL3D_NONE;
+  edge.to_delete = 0;
+  add_edge (e);
+  return e;
 }
 
-/********************/
-/*** Chull3D_face ***/
-/********************/
-Chull3D_face::Chull3D_face (Chull3D *hull3D, Chull3D_vertex *v1, Chull3D_vertex *v2, Chull3D_vertex *v3, Chull3D_face *f)
+int
+Chull3D::new_face (int v1, int v2, int v3, int f)
 {
-  Chull3D_edge *e0, *e1, *e2;
+  int e0, e1, e2;
 
   /* create edges of the initial triangle */
-  if (!f)
+  if (f == CHULL3D_NONE)
     {
-      e0 = new Chull3D_edge (hull3D);
-      e1 = new Chull3D_edge (hull3D);
-      e2 = new Chull3D_edge (hull3D);
+      e0 = new_edge ();
+      e1 = new_edge ();
+      e2 = new_edge ();
     }
   else
     {
-      e0 = f->edges[2];
-      e1 = f->edges[1];
-      e2 = f->edges[0];
+      e0 = face_pool[f].edges[2];
+      e1 = face_pool[f].edges[1];
+      e2 = face_pool[f].edges[0];
     }
-  e0->end_points[0] = v1;       e0->end_points[1] = v2;
-  e1->end_points[0] = v2;       e1->end_points[1] = v3;
-  e2->end_points[0] = v3;       e2->end_points[1] = v1;
+  edge_pool[e0].end_points[0] = v1;       edge_pool[e0].end_points[1] = v2;
+  edge_pool[e1].end_points[0] = v2;       edge_pool[e1].end_points[1] = v3;
+  edge_pool[e2].end_points[0] = v3;       edge_pool[e2].end_points[1] = v1;
 
   /* create face for triangle */
-  edges[0]    = e0;    edges[1]    = e1;    edges[2]    = e2;
-  vertices[0] = v1;    vertices[1] = v2;    vertices[2] = v3;
-  visible = 0;
+  int nf = face_pool.alloc ();
+  Chull3D_face &face = face_pool[nf];
+  face.edges[0]    = e0;    face.edges[1]    = e1;    face.edges[2]    = e2;
+  face.vertices[0] = v1;    face.vertices[1] = v2;    face.vertices[2] = v3;
+  face.visible = 0;
 
   /* links edges to face */
-  e0->adj_faces[0] = e1->adj_faces[0] = e2->adj_faces[0] = this;
+  edge_pool[e0].adj_faces[0] = edge_pool[e1].adj_faces[0] = edge_pool[e2].adj_faces[0] = nf;
 
-  hull3D->add_face (this);
+  add_face (nf);
+  return nf;
 }
 
 /*
  * makes a new face and two new edges between the edge and the point
  * that are passed to it.
  */
-Chull3D_face::Chull3D_face (Chull3D *hull3D, Chull3D_edge *e, Chull3D_vertex *v)
+int
+Chull3D::new_cone_face (int e, int v)
 {
-  Chull3D_edge *new_edges[2];
+  int new_edges[2];
   int i,j;
 
   /* make two new edges (if don't already exist)*/
   for (i=0; i<2; ++i)
-    /* if the edge exists, copy it into new_edges */
-    if (!(new_edges[i] = e->end_points[i]->duplicate))
-      {
-        /* otherwise (duplicate is NULL) */
-        new_edges[i] = new Chull3D_edge (hull3D);
-        new_edges[i]->end_points[0] = e->end_points[i];
-        new_edges[i]->end_points[1] = v;
-        e->end_points[i]->duplicate = new_edges[i];
-      }
+    {
+      int end_point = edge_pool[e].end_points[i];
+      /* if the edge exists, copy it into new_edges */
+      if ((new_edges[i] = vertex_pool[end_point].duplicate) == CHULL3D_NONE)
+        {
+          /* otherwise (duplicate is NULL) */
+          new_edges[i] = new_edge ();
+          edge_pool[new_edges[i]].end_points[0] = end_point;
+          edge_pool[new_edges[i]].end_points[1] = v;
+          vertex_pool[end_point].duplicate = new_edges[i];
+        }
+    }
 
   /* make the new face */
-  edges[0] = e;
-  edges[1] = new_edges[0];
-  edges[2] = new_edges[1];
-  visible = 0;
-  make_ccw (e, v);
+  int nf = face_pool.alloc ();
+  Chull3D_face &face = face_pool[nf];
+  face.edges[0] = e;
+  face.edges[1] = new_edges[0];
+  face.edges[2] = new_edges[1];
+  face.visible = 0;
+  make_ccw (nf, e, v);
 
   /* set the adjacent face pointers */
   for (i=0; i<2; ++i)
     for (j=0; j<2; ++j)
       /* only the NULL link should be set to this face */
-      if (!new_edges[i]->adj_faces[j])
+      if (edge_pool[new_edges[i]].adj_faces[j] == CHULL3D_NONE)
       {
-        new_edges[i]->adj_faces[j] = this;
+        edge_pool[new_edges[i]].adj_faces[j] = nf;
         break;
       }
 
-  hull3D->add_face (this);
+  add_face (nf);
+  return nf;
 }
 
 /*
@@ -624,34 +634,36 @@ Chull3D_face::Chull3D_face (Chull3D *hull3D, Chull3D_edge *e, Chull3D_vertex *v)
  * f->vertex[i] and f->vertex[(i+1)%3].  (Thanks to Bob Williamson.)
  */
 void
-Chull3D_face::make_ccw (Chull3D_edge *e, Chull3D_vertex *v)
+Chull3D::make_ccw (int f, int e, int v)
 {
-  Chull3D_face *fv; /* the visible face adjacent to e */
-  int i;            /* index of e->end_points[0] in fv */
-  Chull3D_edge *s;  /* temporary, for swapping */
+  Chull3D_face &face = face_pool[f];
+  const Chull3D_edge &edge = edge_pool[e];
+  int fv; /* the visible face adjacent to e */
+  int i;  /* index of e->end_points[0] in fv */
+  int s;  /* temporary, for swapping */
 
-  if (e->adj_faces[0]->visible) fv = e->adj_faces[0];
-  else                          fv = e->adj_faces[1];
+  if (face_pool[edge.adj_faces[0]].visible) fv = edge.adj_faces[0];
+  else                                      fv = edge.adj_faces[1];
 
   /* set vertices[0] & vertices[1] to have the same orientation as do
      the corresponding  vertices of fv */
-  for (i=0; fv->vertices[i] != e->end_points[0]; ++i) {}
+  for (i=0; face_pool[fv].vertices[i] != edge.end_points[0]; ++i) {}
 
   /* orient this the same as fv */
-  if (fv->vertices[(i+1)%3] != e->end_points[1])
+  if (face_pool[fv].vertices[(i+1)%3] != edge.end_points[1])
     {
-      vertices[0] = e->end_points[1];
-      vertices[1] = e->end_points[0];
+      face.vertices[0] = edge.end_points[1];
+      face.vertices[1] = edge.end_points[0];
     }
   else
     {
-      vertices[0] = e->end_points[0];
-      vertices[1] = e->end_points[1];
-      SWAP (s, edges[1], edges[2]);
+      face.vertices[0] = edge.end_points[0];
+      face.vertices[1] = edge.end_points[1];
+      SWAP (s, face.edges[1], face.edges[2]);
     }
 
   /* this swap is tricky. e is edges[0]. edges[1] is based on end_points[0],
      edges[2] on end_points[1]. So if e is oriented "forwards", we need to
      move  edges[1] to follow [0], because it precedes */
-  vertices[2] = v;
+  face.vertices[2] = v;
 }
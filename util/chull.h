@@ -14,6 +14,13 @@
  * This adaptation provides a class Chull3D which computes the
  * 3D convex hull of a set of vertices.
  *
+ * Instead of allocating every vertex, edge and face with new and
+ * delete, the records live in pools (growable arrays with a free
+ * list) and link to each other by index. The faces and edges that
+ * are deleted after each point insertion are recycled by the next
+ * insertion, so building a hull only touches the allocator when a
+ * pool grows.
+ *
  *   +-------+
  *  / Input /
  * +-------+
@@ -32,8 +39,9 @@
  * as follows:
  * vertices (from the class Chull3D) contains the vertices of the
  * hull. faces contains the faces defining the hull.
- * The result can be sent in a OBJ file (export_obj) or into arrays
- * for visualization.
+ * The result can be sent into arrays (get_convex_hull), into a mesh
+ * made only of the hull vertices (export_mesh), or as triangles
+ * indexing the input vertices (export_triangles).
  *
  ********************************************************************/
 #ifndef __CHULL3D_H__
@@ -41,22 +49,99 @@
 
 #include "document.h"
 
-class Chull3D_vertex;
-class Chull3D_edge;
-class Chull3D_face;
+/* index used instead of a NULL link */
+#define CHULL3D_NONE -1
+
+/**********************/
+/*** Chull3D_vertex ***/
+/**********************/
+struct Chull3D_vertex
+{
+  float pt[3];
+  int   duplicate;   /* edge */
+  short on_hull;
+  short processed;
+  int   prev, next;
+};
+
+/********************/
+/*** Chull3D_edge ***/
+/********************/
+struct Chull3D_edge
+{
+  int adj_faces[2];
+  int end_points[2];
+  int new_face;
+  int to_delete;
+  int prev, next;
+};
+
+/********************/
+/*** Chull3D_face ***/
+/********************/
+struct Chull3D_face
+{
+  int edges[3];
+  int vertices[3];
+  int visible;
+  int prev, next;
+};
+
+/*********************/
+/*** Chull3D_pool ***/
+/*********************/
+/*
+ * Storage for one kind of record. Released records are chained
+ * through their next field and handed out again before the array
+ * grows. Records are addressed by index, so growing the array does
+ * not invalidate any link (but it does invalidate references).
+ */
+template <class T>
+class Chull3D_pool
+{
+ public:
+  Chull3D_pool () : free_head (CHULL3D_NONE) {}
+
+  void reserve (int n) { items.reserve (n); }
+  int  size    (void) const { return items.size (); }
+
+  int alloc (void)
+  {
+    int i = free_head;
+    if (i != CHULL3D_NONE)
+      free_head = items[i].next;
+    else
+      {
+        i = items.size ();
+        items.resize (i + 1);
+      }
+    return i;
+  }
+
+  void release (int i)
+  {
+    items[i].next = free_head;
+    free_head = i;
+  }
+
+  T       &operator [] (int i)       { return items[i]; }
+  const T &operator [] (int i) const { return items[i]; }
+
+ private:
+  QVector<T> items;
+  int        free_head;
+};
 
 /***************/
 /*** Chull3D ***/
 /***************/
 class Chull3D
 {
-  friend class Chull3D_edge;
-  friend class Chull3D_face;
  public:
-  Chull3D (float *vertices, int n_vertices);
-  ~Chull3D ();
+  Chull3D (const float *vertices, int n_vertices);
 
-  void compute        (void);
+  /* returns 0 on success, 1 if the points are collinear or coplanar */
+  int  compute        (void);
 
   int  get_n_vertices (void);
   int  get_n_faces    (void);
@@ -64,89 +149,43 @@ class Chull3D
   /* output */
   int get_convex_hull (float **vertices, int *n_vertices, int **faces, int *n_faces);
   void export_mesh (Mesh &mesh);
+  void export_triangles (QVector<Triangle> &triangles);
 
  private:
-  void add_vertex    (Chull3D_vertex *v);
-  void add_edge      (Chull3D_edge *e);
-  void add_face      (Chull3D_face *f);
-  void delete_vertex (Chull3D_vertex *v);
-  void delete_edge   (Chull3D_edge *e);
-  void delete_face   (Chull3D_face *f);
-
-  int are_collinear   (Chull3D_vertex *v1, Chull3D_vertex *v2, Chull3D_vertex *v3);
-  int volume_sign     (Chull3D_face *f, Chull3D_vertex *v);
-  int add_one         (Chull3D_vertex *v);
-  void clean_up       (Chull3D_vertex *vnext);
+  void add_vertex    (int v);
+  void add_edge      (int e);
+  void add_face      (int f);
+  void delete_vertex (int v);
+  void delete_edge   (int e);
+  void delete_face   (int f);
+
+  int  new_edge      (void);
+  int  new_face      (int v1, int v2, int v3, int f);
+  int  new_cone_face (int e, int v);
+  void make_ccw      (int f, int e, int v);
+
+  int are_collinear   (int v1, int v2, int v3);
+  int volume_sign     (int f, int v);
+  int add_one         (int v);
+  void clean_up       (void);
   void clean_edges    (void);
   void clean_faces    (void);
-  void clean_vertices (Chull3D_vertex *vnext);
+  void clean_vertices (void);
   int double_triangle (void);
   int construct_hull  (void);
 
-  int get_vertex_index (Chull3D_vertex *v);
-
- private:
-  Chull3D_vertex *vertices;
-  Chull3D_edge *edges;
-  Chull3D_face *faces;
-};
-
-/**********************/
-/*** Chull3D_vertex ***/
-/**********************/
-class Chull3D_vertex
-{
-  friend class Chull3D;
-  friend class Chull3D_face;
- public:
-  Chull3D_vertex () {};
-  Chull3D_vertex (float x, float y, float z);
-
  private:
-  float          pt[3];
-  Chull3D_edge   *duplicate;
-  short          on_hull;
-  short          processed;
-  Chull3D_vertex *prev, *next;
-};
+  QVector<Chull3D_vertex>     vertex_pool;
+  Chull3D_pool<Chull3D_edge>  edge_pool;
+  Chull3D_pool<Chull3D_face>  face_pool;
 
-/********************/
-/*** Chull3D_edge ***/
-/********************/
-class Chull3D_edge
-{
-  friend class Chull3D;
-  friend class Chull3D_face;
- public:
-  Chull3D_edge (Chull3D *hull3D);
+  /* list heads */
+  int vertices;
+  int edges;
+  int faces;
 
- private:
-  Chull3D_face   *adj_faces[2];
-  Chull3D_vertex *end_points[2];
-  Chull3D_face   *new_face;
-  int            to_delete;
-  Chull3D_edge   *prev, *next;
-};
-
-/********************/
-/*** Chull3D_face ***/
-/********************/
-class Chull3D_face
-{
-  friend class Chull3D;
- public:
-  Chull3D_face (Chull3D *hull3D, Chull3D_vertex *v1, Chull3D_vertex *v2, Chull3D_vertex *v3, Chull3D_face *f);
-  Chull3D_face (Chull3D *hull3D, Chull3D_edge *e, Chull3D_vertex *v);
-
- private:
-  void make_ccw (Chull3D_edge *e, Chull3D_vertex *v);
-
- private:
-  Chull3D_edge   *edges[3];
-  Chull3D_vertex *vertices[3];
-  int            visible;
-  Chull3D_face   *prev, *next;
+  /* first vertex added after the initial double triangle */
+  int first;
 };
 
 #endif /* __CHULL3D_H__ */
-
@@ -1,40 +1,18 @@
 #include "convexhull3d.h"
-
-#if 0
 #include "chull.h"
-
-void ConvexHull3D::run(Mesh &mesh)
-{
-    QVector<Vector3> vertices;
-    foreach (const Vertex &vertex, mesh.vertices)
-        vertices += vertex.pos;
-
-    Chull3D ch(vertices[0].xyz, vertices.count());
-    ch.compute();
-    ch.export_mesh(mesh);
-    mesh.updateNormals();
-}
-
-#else
+#include "profiler.h"
 #include "Wm5ConvexHull3.h"
 #define COMPILE_TIME_ASSERT(pred) switch(0){case 0:case pred:;}
 
-void ConvexHull3D::run(Mesh &mesh)
-{
-    // reset faces
-    mesh.triangles.clear();
-    mesh.quads.clear();
-    if (mesh.vertices.isEmpty())
-        return;
-
-    // copy vertices to array
-    QVector<Vector3> vertices;
-    foreach (const Vertex &vertex, mesh.vertices)
-        vertices += vertex.pos;
+// relative tolerance for the dimension test, also used as the uncertainty in
+// [0, 1] below which QT_FILTERED repeats a query with rational arithmetic
+#define HULL_EPSILON 0.0001f
 
+static void runWm5(Mesh &mesh, const QVector<Vector3> &vertices, Wm5::Query::Type queryType)
+{
     // call library
     COMPILE_TIME_ASSERT(sizeof(Vector3) == sizeof(Wm5::Vector3f));
-    Wm5::ConvexHull3f hull(vertices.count(), (Wm5::Vector3f *)vertices[0].xyz, 0.0001f, false, Wm5::Query::QT_INT64);
+    Wm5::ConvexHull3f hull(vertices.count(), (Wm5::Vector3f *)vertices[0].xyz, HULL_EPSILON, false, queryType);
 
     // we can also get 0d, 1d, and 2d output, but we can't use those
     if (hull.GetDimension() == 3)
@@ -49,4 +27,31 @@ void ConvexHull3D::run(Mesh &mesh)
             mesh.triangles += Triangle(indices[i * 3], indices[i * 3 + 1], indices[i * 3 + 2]);
     }
 }
-#endif
+
+static void runChull(Mesh &mesh, const QVector<Vector3> &vertices)
+{
+    // collinear and coplanar input produces no triangles, like Wm5
+    Chull3D hull(vertices[0].xyz, vertices.count());
+    if (!hull.compute())
+        hull.export_triangles(mesh.triangles);
+}
+
+void ConvexHull3D::run(Mesh &mesh, Wm5::Query::Type queryType, Backend backend)
+{
+    PROFILE_SCOPE("ConvexHull3D::run");
+    // reset faces
+    mesh.triangles.clear();
+    mesh.quads.clear();
+    if (mesh.vertices.isEmpty())
+        return;
+
+    // copy vertices to array
+    QVector<Vector3> vertices;
+    foreach (const Vertex &vertex, mesh.vertices)
+        vertices += vertex.pos;
+
+    if (backend == CHULL)
+        runChull(mesh, vertices);
+    else
+        runWm5(mesh, vertices, queryType);
+}
@@ -2,11 +2,21 @@
 #define CONVEXHULL3D_H
 
 #include "document.h"
+#include "Wm5Query.h"
 
 class ConvexHull3D
 {
 public:
-    static void run(Mesh &mesh);
+    enum Backend
+    {
+        WM5,  // Wm5::ConvexHull3, using queryType for the orientation tests
+        CHULL // the O'Rourke incremental hull in chull.h, backed by pools
+    };
+
+    // QT_FILTERED uses floating-point orientation tests and only falls back
+    // to exact rational arithmetic when a test is too close to call, so it is
+    // both fast and robust for the nearly coplanar points generated at joints
+    static void run(Mesh &mesh, Wm5::Query::Type queryType = Wm5::Query::QT_FILTERED, Backend backend = WM5);
 };
 
 #endif // CONVEXHULL3D_H
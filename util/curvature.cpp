@@ -1,10 +1,11 @@
 #include "curvature.h"
-#include "matrix.h"
 #include "mesh.h"
+#include "profiler.h"
+#include "parallel.h"
 #include "qgl.h"
 
 // fills in u and v given w
-void generateComplementBasis(Vector3& u, Vector3& v, const Vector3& w) {
+static void generateComplementBasis(Vector3& u, Vector3& v, const Vector3& w) {
     float invLength;
 
     if (fabsf(w.x) >= fabsf(w.y)) {
@@ -29,163 +30,214 @@ void generateComplementBasis(Vector3& u, Vector3& v, const Vector3& w) {
 }
 
 
-void Curvature::computeCurvatures(const Mesh &mesh) {
-    int nVerts = mesh.vertices.size();
+static void addCorner(int *cursor, int *neighbors, int vertex, int next, int prev) {
+    int i = cursor[vertex];
+    cursor[vertex] += 2;
+    neighbors[i] = next;
+    neighbors[i + 1] = prev;
+}
 
-    // Compute the matrix of normal derivatives.
-    QVector<Matrix3> DNormal(nVerts);
-    QVector<Matrix3> WWTrn(nVerts);
-    QVector<Matrix3> DWTrn(nVerts);
-    bool DWTrnZero[nVerts];
+void Curvature::computeNeighbors(const Mesh &mesh) {
+    int nVerts = mesh.vertices.size();
 
-    int row, col;
+    // count the corners at each vertex, then fill them in
+    edgeOffsets.fill(0, nVerts + 1);
+    int *offsets = edgeOffsets.data();
+    foreach (const Triangle &t, mesh.triangles) {
+        offsets[t.a.index + 1] += 2;
+        offsets[t.b.index + 1] += 2;
+        offsets[t.c.index + 1] += 2;
+    }
     foreach (const Quad &q, mesh.quads) {
-        // Get vertex indices.
-        int V[4];
-        V[0] = q.a.index;
-        V[1] = q.b.index;
-        V[2] = q.c.index;
-        V[3] = q.d.index;
-
-        for (int j = 0; j < 4; ++j) {
-            int i0 = V[j];
-            const Vertex &v0 = mesh.vertices[V[j]];
-            const Vertex &v1 = mesh.vertices[V[(j+1) % 4]];
-            const Vertex &v2 = mesh.vertices[V[(j+3) % 4]];
-
-            // Compute edge from V0 to V1, project to tangent plane of vertex,
-            // and compute difference of adjacent normals.
-            Vector3 E = v1.pos - v0.pos;
-            Vector3 W = E - (E.dot(v0.normal)) * v0.normal;
-            Vector3 D = v1.normal - v0.normal;
-            for (row = 0; row < 3; ++row) {
-                for (col = 0; col < 3; ++col) {
-                    WWTrn[i0][row][col] += W.xyz[row] * W.xyz[col];
-                    DWTrn[i0][row][col] += D.xyz[row] * W.xyz[col];
-                }
-            }
-
-            // Compute edge from V0 to V2, project to tangent plane of vertex,
-            // and compute difference of adjacent normals.
-            E = v2.pos - v0.pos;
-            W = E - (E.dot(v0.normal)) * v0.normal;
-            D = v2.normal - v0.normal;
-            for (row = 0; row < 3; ++row) {
-                for (col = 0; col < 3; ++col) {
-                    WWTrn[i0][row][col] += W.xyz[row] * W.xyz[col];
-                    DWTrn[i0][row][col] += D.xyz[row] * W.xyz[col];
-                }
-            }
-        }
+        offsets[q.a.index + 1] += 2;
+        offsets[q.b.index + 1] += 2;
+        offsets[q.c.index + 1] += 2;
+        offsets[q.d.index + 1] += 2;
     }
+    for (int i = 0; i < nVerts; ++i)
+        offsets[i + 1] += offsets[i];
+
+    vertexCount = nVerts;
+    triangleCount = mesh.triangles.size();
+    quadCount = mesh.quads.size();
+
+    QVector<int> cursor(edgeOffsets);
+    edgeNeighbors.resize(offsets[nVerts]);
+    int *neighbors = edgeNeighbors.data();
+    foreach (const Triangle &t, mesh.triangles) {
+        addCorner(cursor.data(), neighbors, t.a.index, t.b.index, t.c.index);
+        addCorner(cursor.data(), neighbors, t.b.index, t.c.index, t.a.index);
+        addCorner(cursor.data(), neighbors, t.c.index, t.a.index, t.b.index);
+    }
+    foreach (const Quad &q, mesh.quads) {
+        addCorner(cursor.data(), neighbors, q.a.index, q.b.index, q.d.index);
+        addCorner(cursor.data(), neighbors, q.b.index, q.c.index, q.a.index);
+        addCorner(cursor.data(), neighbors, q.c.index, q.d.index, q.b.index);
+        addCorner(cursor.data(), neighbors, q.d.index, q.a.index, q.c.index);
+    }
+}
 
-    // Add in N*N^T to W*W^T for numerical stability.  In theory 0*0^T gets
-    // added to D*W^T, but of course no update is needed in the
-    // implementation.  Compute the matrix of normal derivatives.
-    for (int i = 0; i < nVerts; ++i) {
-        for (row = 0; row < 3; ++row) {
-            for (col = 0; col < 3; ++col) {
-                WWTrn[i][row][col] = 0.5f * WWTrn[i][row][col] + mesh.vertices[i].normal.xyz[row] * mesh.vertices[i].normal.xyz[col];
-                DWTrn[i][row][col] *= 0.5f;
+// Eigenvalues of the symmetric matrix [s00 s01; s01 s11] and the unit
+// eigenvector (c, s) of the larger one, the other one is (-s, c).
+static void symmetricEigen2(float s00, float s01, float s11, float &minValue, float &maxValue, float &c, float &s) {
+    float halfTrace = 0.5f * (s00 + s11);
+    float halfDiff = 0.5f * (s00 - s11);
+    float root = sqrtf(halfDiff * halfDiff + s01 * s01);
+    minValue = halfTrace - root;
+    maxValue = halfTrace + root;
+    float angle = 0.5f * atan2f(s01, halfDiff);
+    c = cosf(angle);
+    s = sinf(angle);
+}
+
+void Curvature::computeRange(int begin, int end) {
+    const int *offsets = edgeOffsets.constData();
+    const int *neighbors = edgeNeighbors.constData();
+    float *minCurvature = minCurvatures.data();
+    float *maxCurvature = maxCurvatures.data();
+    Vector3 *minDirection = minDirections.data();
+    Vector3 *maxDirection = maxDirections.data();
+
+    for (int k = begin; k < end; ++k) {
+        int i = activeVertices ? activeVertices[k] : k;
+        const Vertex &v0 = vertices[i];
+        const Vector3 &N = v0.normal;
+
+        // Sum W*W^T (symmetric, so only the upper triangle) and D*W^T over
+        // the edges to the neighbors before and after the vertex in each
+        // face, where W is the edge projected to the tangent plane of the
+        // vertex and D is the difference of the normals along it.
+        float xx = 0.f, xy = 0.f, xz = 0.f, yy = 0.f, yz = 0.f, zz = 0.f;
+        float DW[3][3] = { { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f } };
+        for (int j = offsets[i]; j < offsets[i + 1]; ++j) {
+            const Vertex &v1 = vertices[neighbors[j]];
+            Vector3 E = v1.pos - v0.pos;
+            Vector3 W = E - (E.dot(N)) * N;
+            Vector3 D = v1.normal - N;
+            xx += W.x * W.x; xy += W.x * W.y; xz += W.x * W.z;
+            yy += W.y * W.y; yz += W.y * W.z; zz += W.z * W.z;
+            for (int row = 0; row < 3; ++row) {
+                DW[row][0] += D.xyz[row] * W.x;
+                DW[row][1] += D.xyz[row] * W.y;
+                DW[row][2] += D.xyz[row] * W.z;
             }
         }
 
-        // Compute the max-abs entry of D*W^T.  If this entry is (nearly)
-        // zero, flag the DNormal matrix as singular.
+        // Add in N*N^T to W*W^T for numerical stability.  In theory 0*0^T gets
+        // added to D*W^T, but of course no update is needed in the
+        // implementation.  If the max-abs entry of D*W^T is (nearly) zero, or
+        // W*W^T can't be inverted, the vertex is at a locally planar point.
+        xx = 0.5f * xx + N.x * N.x; xy = 0.5f * xy + N.x * N.y; xz = 0.5f * xz + N.x * N.z;
+        yy = 0.5f * yy + N.y * N.y; yz = 0.5f * yz + N.y * N.z; zz = 0.5f * zz + N.z * N.z;
         float maxAbs = 0.f;
-        for (row = 0; row < 3; ++row) {
-            for (col = 0; col < 3; ++col) {
-                float absEntry = fabsf(DWTrn[i][row][col]);
-                if (absEntry > maxAbs) {
-                    maxAbs = absEntry;
-                }
+        for (int row = 0; row < 3; ++row) {
+            for (int col = 0; col < 3; ++col) {
+                DW[row][col] *= 0.5f;
+                maxAbs = max(maxAbs, fabsf(DW[row][col]));
             }
         }
-        if (maxAbs < 1e-07) {
-            DWTrnZero[i] = true;
+
+        // The inverse of the symmetric W*W^T from its cofactors
+        float c00 = yy * zz - yz * yz, c01 = xz * yz - xy * zz, c02 = xy * yz - xz * yy;
+        float c11 = xx * zz - xz * xz, c12 = xy * xz - xx * yz, c22 = xx * yy - xy * xy;
+        float det = xx * c00 + xy * c01 + xz * c02;
+
+        Vector3 U, V;
+        generateComplementBasis(U, V, N);
+        if (!(maxAbs >= 1e-07f) || !(det > 0.f)) {
+            minCurvature[i] = 0.f;
+            maxCurvature[i] = 0.f;
+            minDirection[i] = U;
+            maxDirection[i] = V;
+            continue;
+        }
+
+        // If N is a unit-length normal at a vertex, let U and V be unit-length
+        // tangents so that {U, V, N} is an orthonormal set.  Define the matrix
+        // J = [U | V], a 3-by-2 matrix whose columns are U and V.  Let dN/dX
+        // = D*W^T * (W*W^T)^{-1} be the matrix of first-order derivatives of
+        // the normal vector field.  The shape matrix is S = J^T * dN/dX * J,
+        // a 2-by-2 matrix whose eigenvalues are the principal curvatures.  If
+        // W is the eigenvector for k, the principal direction for k is J*W.
+        float invDet = 1.f / det;
+        Vector3 WU = Vector3(c00 * U.x + c01 * U.y + c02 * U.z, c01 * U.x + c11 * U.y + c12 * U.z, c02 * U.x + c12 * U.y + c22 * U.z) * invDet;
+        Vector3 WV = Vector3(c00 * V.x + c01 * V.y + c02 * V.z, c01 * V.x + c11 * V.y + c12 * V.z, c02 * V.x + c12 * V.y + c22 * V.z) * invDet;
+        Vector3 dNdU, dNdV;
+        for (int row = 0; row < 3; ++row) {
+            dNdU.xyz[row] = DW[row][0] * WU.x + DW[row][1] * WU.y + DW[row][2] * WU.z;
+            dNdV.xyz[row] = DW[row][0] * WV.x + DW[row][1] * WV.y + DW[row][2] * WV.z;
         }
 
-        DNormal[i] = DWTrn[i] * WWTrn[i].inverse();
+        // In theory S is symmetric, but because we have estimated dN/dX, we
+        // must slightly adjust our calculations to make sure S is symmetric.
+        float c, s;
+        symmetricEigen2(U.dot(dNdU), 0.5f * (U.dot(dNdV) + V.dot(dNdU)), V.dot(dNdV), minCurvature[i], maxCurvature[i], c, s);
+        maxDirection[i] = c * U + s * V;
+        minDirection[i] = c * V - s * U;
     }
+}
+
+void Curvature::computeCurvatures(const Mesh &mesh) {
+    PROFILE_SCOPE("Curvature::computeCurvatures");
+    int nVerts = mesh.vertices.size();
+    computeNeighbors(mesh);
 
-    // If N is a unit-length normal at a vertex, let U and V be unit-length
-    // tangents so that {U, V, N} is an orthonormal set.  Define the matrix
-    // J = [U | V], a 3-by-2 matrix whose columns are U and V.  Define J^T
-    // to be the transpose of J, a 2-by-3 matrix.  Let dN/dX denote the
-    // matrix of first-order derivatives of the normal vector field.  The
-    // shape matrix is
-    //   S = (J^T * J)^{-1} * J^T * dN/dX * J = J^T * dN/dX * J
-    // where the superscript of -1 denotes the inverse.  (The formula allows
-    // for J built from non-perpendicular vectors.) The matrix S is 2-by-2.
-    // The principal curvatures are the eigenvalues of S.  If k is a principal
-    // curvature and W is the 2-by-1 eigenvector corresponding to it, then
-    // S*W = k*W (by definition).  The corresponding 3-by-1 tangent vector at
-    // the vertex is called the principal direction for k, and is J*W.
     minCurvatures.resize(nVerts);
     maxCurvatures.resize(nVerts);
     minDirections.resize(nVerts);
     maxDirections.resize(nVerts);
 
-    for (int i = 0; i < nVerts; ++i) {
-        // Compute U and V given N.
-        Vector3 U, V;
-        generateComplementBasis(U, V, mesh.vertices[i].normal);
-
-        if (DWTrnZero[i]) {
-            // At a locally planar point.
-            minCurvatures[i] = 0.f;
-            maxCurvatures[i] = 0.f;
-            minDirections[i] = U;
-            maxDirections[i] = V;
-            continue;
-        }
+    // each vertex only reads its neighbors and writes itself
+    vertices = mesh.vertices.constData();
+    parallelFor(nVerts, this, &Curvature::computeRange);
+}
 
-        // Compute S = J^T * dN/dX * J.  In theory S is symmetric, but
-        // because we have estimated dN/dX, we must slightly adjust our
-        // calculations to make sure S is symmetric.
-        float s01 = U.dot(DNormal[i] * V);
-        float s10 = V.dot(DNormal[i] * U);
-        float sAvr = 0.5f * (s01 + s10);
-        float S[2][2];
-        S[0][0] = U.dot(DNormal[i]*U);
-        S[0][1] = sAvr;
-        S[1][0] = sAvr;
-        S[1][1] = V.dot(DNormal[i]*V);
-
-        // Compute the eigenvalues of S (min and max curvatures).
-        float trace = S[0][0] + S[1][1];
-        float det = S[0][0] * S[1][1] - S[0][1] * S[1][0];
-        float discr = trace * trace - 4.0f * det;
-        float rootDiscr = sqrtf(fabsf(discr));
-        minCurvatures[i] = 0.5f * (trace - rootDiscr);
-        maxCurvatures[i] = 0.5f * (trace + rootDiscr);
-
-        // Compute the eigenvectors of S.
-        Vector2 W0(S[0][1], minCurvatures[i] - S[0][0]);
-        Vector2 W1(minCurvatures[i] - S[1][1], S[1][0]);
-        if (W0.lengthSquared() >= W1.lengthSquared()) {
-            W0.normalize();
-            minDirections[i] = W0.x * U + W0.y * V;
-        } else {
-            W1.normalize();
-            minDirections[i] = W1.x * U + W1.y * V;
-        }
+bool Curvature::hasSameCounts(const Mesh &mesh) const {
+    return vertexCount == mesh.vertices.size() && edgeOffsets.size() == vertexCount + 1 &&
+        triangleCount == mesh.triangles.size() && quadCount == mesh.quads.size();
+}
 
-        W0 = Vector2(S[0][1], maxCurvatures[i] - S[0][0]);
-        W1 = Vector2(maxCurvatures[i] - S[1][1], S[1][0]);
-        if (W0.lengthSquared() >= W1.lengthSquared()) {
-            W0.normalize();
-            maxDirections[i] = W0.x * U + W0.y * V;
-        } else {
-            W1.normalize();
-            maxDirections[i] = W1.x * U + W1.y * V;
+void Curvature::updateCurvatures(const Mesh &mesh, const QVector<int> &changedVertices) {
+    if (!hasSameCounts(mesh)) {
+        computeCurvatures(mesh);
+        return;
+    }
+    PROFILE_SCOPE("Curvature::updateCurvatures");
+    if (vertexUpdated.size() != vertexCount)
+        vertexUpdated.fill(false, vertexCount);
+
+    // a vertex's curvature only depends on it and its neighbors, and
+    // neighbors go both ways
+    updatedVertices.clear();
+    foreach (int i, changedVertices) {
+        if (i < 0 || i >= vertexCount) continue;
+        if (!vertexUpdated[i]) {
+            vertexUpdated[i] = true;
+            updatedVertices += i;
+        }
+        for (int j = edgeOffsets[i]; j < edgeOffsets[i + 1]; ++j) {
+            int neighbor = edgeNeighbors[j];
+            if (!vertexUpdated[neighbor]) {
+                vertexUpdated[neighbor] = true;
+                updatedVertices += neighbor;
+            }
         }
     }
+    PROFILE_COUNTER("curvature vertices updated", updatedVertices.size());
+
+    vertices = mesh.vertices.constData();
+    activeVertices = updatedVertices.constData();
+    parallelFor(updatedVertices.size(), this, &Curvature::computeRange, 256);
+    activeVertices = NULL;
+
+    foreach (int i, updatedVertices)
+        vertexUpdated[i] = false;
 }
 
 
 void Curvature::drawCurvatures(const Mesh &mesh) {
-    computeCurvatures(mesh);
+    if (maxDirections.size() != mesh.vertices.size())
+        computeCurvatures(mesh);
 
     glBegin(GL_LINES);
     for (int i = 0; i < mesh.vertices.size(); ++i) {
@@ -7,7 +7,18 @@
 class Curvature
 {
 public:
+    Curvature() : vertexCount(0), triangleCount(0), quadCount(0), vertices(NULL), activeVertices(NULL) {}
+
     void computeCurvatures(const Mesh &mesh);
+
+    // Recomputes only the changed vertices (positions or normals) and their
+    // neighbors, which is everything a change to them affects. The faces
+    // must be the same as in the last computeCurvatures(), so call that
+    // instead after the topology changes. Different face or vertex counts
+    // are caught and also compute everything.
+    void updateCurvatures(const Mesh &mesh, const QVector<int> &changedVertices);
+
+    // draws the directions from the last update, computing them if there are none
     void drawCurvatures(const Mesh &mesh);
     const QVector<float>& getMinCurvatures() { return minCurvatures; }
     const QVector<float>& getMaxCurvatures() { return maxCurvatures; }
@@ -19,6 +30,25 @@ private:
     QVector<float> maxCurvatures;
     QVector<Vector3> minDirections;
     QVector<Vector3> maxDirections;
+
+    // the vertices after and before vertex i in each of its faces (triangles
+    // and quads) are edgeNeighbors[edgeOffsets[i]] up to edgeNeighbors[edgeOffsets[i + 1]],
+    // kept between calls so recomputing doesn't allocate
+    QVector<int> edgeOffsets;
+    QVector<int> edgeNeighbors;
+
+    // the size of the mesh the neighbors were found for
+    int vertexCount, triangleCount, quadCount;
+
+    // computeRange() goes through activeVertices instead if it isn't NULL
+    const Vertex *vertices;
+    const int *activeVertices;
+    QVector<int> updatedVertices;
+    QVector<char> vertexUpdated;
+
+    bool hasSameCounts(const Mesh &mesh) const;
+    void computeNeighbors(const Mesh &mesh);
+    void computeRange(int begin, int end);
 };
 
 #endif // CURVATURE_H
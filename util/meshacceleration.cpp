@@ -1,5 +1,6 @@
 #include "meshacceleration.h"
 #include "geometry.h"
+#include "profiler.h"
 #include <qgl.h>
 
 Vector3 VoxelGrid::convertToGrid(const Vector3 &pos) const
@@ -89,6 +90,7 @@ void VoxelGrid::addQuadToVoxels(Quad &quad)
 
 VoxelGrid::VoxelGrid(MetaMesh &mesh, float spacing) : AccelerationDataStructure(mesh), countX(0), countY(0), countZ(0)
 {
+    PROFILE_SCOPE("VoxelGrid::build");
     if (mesh.vertices.isEmpty())
         return;
 
@@ -270,6 +272,7 @@ void VoxelGrid::getVerticesInAABB(const Vector3 &minCoord, const Vector3 &maxCoo
 
 void VoxelGrid::updateVertices(const QSet<MetaVertex *> &changedVertices)
 {
+    PROFILE_SCOPE("VoxelGrid::updateVertices");
     QSet<Quad *> affectedQuads;
 
     // Move the vertices to new voxels
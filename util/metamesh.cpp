@@ -3,7 +3,7 @@
 MetaMesh::MetaMesh(Mesh &mesh) : mesh(mesh)
 {
     for (int i = 0; i < mesh.vertices.count(); i++)
-        vertices += new MetaVertex(mesh.vertices[i]);
+        vertices += new MetaVertex(mesh.vertices[i], i);
 
     for (int i = 0; i < mesh.quads.count(); i++)
     {
@@ -7,6 +7,7 @@ class MetaVertex
 {
 public:
     int accelData;
+    int index;
     Vertex &wrappedVertex;
     Vector3 &pos;
     Vector3 &normal;
@@ -14,7 +15,7 @@ public:
     Vector3 prevNormal;
     QVector<Quad *> neighbors;
 
-    MetaVertex(Vertex &vertex) : accelData(0), wrappedVertex(vertex), pos(vertex.pos), normal(vertex.normal), prevPos(vertex.pos), prevNormal(vertex.normal) {}
+    MetaVertex(Vertex &vertex, int index) : accelData(0), index(index), wrappedVertex(vertex), pos(vertex.pos), normal(vertex.normal), prevPos(vertex.pos), prevNormal(vertex.normal) {}
 };
 
 class MetaMesh
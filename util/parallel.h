@@ -0,0 +1,62 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <QtConcurrentMap>
+#include <QThreadPool>
+#include <QVector>
+
+/**
+ * A parallel for loop over the global QThreadPool. The range [0, count) is
+ * cut into contiguous blocks and object->method(begin, end) is called once
+ * per block, returning when every block is done:
+ *
+ *     void CatmullMesh::computeFacePoints(int begin, int end) { ... }
+ *     parallelFor(numFaces, this, &CatmullMesh::computeFacePoints);
+ *
+ * Blocks never overlap, so as long as the method only writes results for the
+ * indices it is given, the output is the same for any number of threads.
+ * Ranges shorter than minBlockSize, or a pool limited to one thread, run
+ * on the calling thread. The thread count can be changed with
+ * QThreadPool::globalInstance()->setMaxThreadCount().
+ */
+
+template <class T>
+struct ParallelBlock
+{
+    T *object;
+    void (T::*method)(int begin, int end);
+    int begin, end;
+};
+
+template <class T>
+void runParallelBlock(ParallelBlock<T> &block)
+{
+    (block.object->*block.method)(block.begin, block.end);
+}
+
+template <class T>
+void parallelFor(int count, T *object, void (T::*method)(int begin, int end), int minBlockSize = 2048)
+{
+    int threads = QThreadPool::globalInstance()->maxThreadCount();
+
+    // a few blocks per thread so one slow block doesn't leave the others idle
+    int numBlocks = qMin(threads * 4, (count + minBlockSize - 1) / minBlockSize);
+    if (threads <= 1 || numBlocks <= 1)
+    {
+        if (count > 0) (object->*method)(0, count);
+        return;
+    }
+
+    QVector<ParallelBlock<T> > blocks(numBlocks);
+    for (int i = 0; i < numBlocks; i++)
+    {
+        ParallelBlock<T> &block = blocks[i];
+        block.object = object;
+        block.method = method;
+        block.begin = (int)((long long)count * i / numBlocks);
+        block.end = (int)((long long)count * (i + 1) / numBlocks);
+    }
+    QtConcurrent::blockingMap(blocks, runParallelBlock<T>);
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,340 @@
+#include "profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutex>
+#include <QVector>
+#include <QHash>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// allocation counting
+////////////////////////////////////////////////////////////////////////////////
+
+// The counts are kept per thread, so scopes running at the same time on
+// other threads (like the batch tool's jobs) don't see each other's
+// allocations. They are plain zero-initialized thread locals, which the
+// allocator can use before any constructors run and without locking.
+#if defined(_MSC_VER)
+#define PROFILE_THREAD_LOCAL __declspec(thread)
+#elif defined(__GLIBC__)
+// initial-exec never allocates on first access, which would recurse into malloc
+#define PROFILE_THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+#else
+#define PROFILE_THREAD_LOCAL __thread
+#endif
+
+static PROFILE_THREAD_LOCAL int allocationCount;
+static PROFILE_THREAD_LOCAL int liveAllocations; // can go negative when freeing another thread's memory
+static PROFILE_THREAD_LOCAL int peakAllocations;
+
+static inline void countAllocation()
+{
+    allocationCount++;
+    if (++liveAllocations > peakAllocations)
+        peakAllocations = liveAllocations;
+}
+
+static inline void countFree()
+{
+    liveAllocations--;
+}
+
+#if defined(__GLIBC__)
+
+// on glibc, replacing malloc counts everything, including the Qt containers
+// (they use qMalloc, not operator new) and operator new itself
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *pointer, size_t size);
+    void __libc_free(void *pointer);
+
+    void *malloc(size_t size)
+    {
+        countAllocation();
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        countAllocation();
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *pointer, size_t size)
+    {
+        if (!pointer) countAllocation();
+        else if (!size) countFree();
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void *pointer)
+    {
+        if (pointer) countFree();
+        __libc_free(pointer);
+    }
+
+    // the aligned allocators have to be counted too, since free() is
+    void *__libc_memalign(size_t alignment, size_t size);
+    void *__libc_valloc(size_t size);
+    void *__libc_pvalloc(size_t size);
+
+    void *memalign(size_t alignment, size_t size)
+    {
+        void *pointer = __libc_memalign(alignment, size);
+        if (pointer) countAllocation();
+        return pointer;
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size)
+    {
+        return memalign(alignment, size);
+    }
+
+    int posix_memalign(void **result, size_t alignment, size_t size)
+    {
+        if (!alignment || (alignment & (alignment - 1)) || alignment % sizeof(void *))
+            return EINVAL;
+        void *pointer = memalign(alignment, size);
+        if (!pointer) return ENOMEM;
+        *result = pointer;
+        return 0;
+    }
+
+    void *valloc(size_t size)
+    {
+        void *pointer = __libc_valloc(size);
+        if (pointer) countAllocation();
+        return pointer;
+    }
+
+    void *pvalloc(size_t size)
+    {
+        void *pointer = __libc_pvalloc(size);
+        if (pointer) countAllocation();
+        return pointer;
+    }
+}
+
+#else
+
+#include <new>
+
+// elsewhere only operator new is counted
+void *operator new(size_t size)
+{
+    countAllocation();
+    void *pointer = malloc(size ? size : 1);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer)
+{
+    if (pointer) countFree();
+    free(pointer);
+}
+
+void operator delete[](void *pointer)
+{
+    operator delete(pointer);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// event recording
+////////////////////////////////////////////////////////////////////////////////
+
+struct ProfileEvent
+{
+    const char *name;
+    long long start; // nanoseconds since the first event
+    long long duration; // -1 for counters
+    int allocations;
+    int peakAllocations;
+    double value;
+    quintptr thread;
+};
+
+// stop recording after this many events so a long session can't use up all
+// memory, the stats used by the overlay keep updating though
+static const int maxEvents = 1 << 22;
+
+static QMutex mutex;
+static QVector<ProfileEvent> events;
+static int droppedEvents = 0;
+static QVector<ProfileStat> statList;
+static QHash<const char *, int> statForName;
+
+static QElapsedTimer startedTimer()
+{
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+}
+
+// started during static initialization, before any threads can race to start it
+static const QElapsedTimer timer = startedTimer();
+
+static long long now()
+{
+    return timer.nsecsElapsed();
+}
+
+static void record(const ProfileEvent &event)
+{
+    QMutexLocker locker(&mutex);
+    if (events.count() < maxEvents)
+    {
+        if (events.isEmpty()) events.reserve(1 << 16);
+        events += event;
+    }
+    else
+        droppedEvents++;
+
+    if (event.duration < 0)
+        return;
+
+    // identical names from different files may not share a pointer
+    int index = statForName.value(event.name, -1);
+    if (index == -1)
+    {
+        for (index = 0; index < statList.count(); index++)
+            if (!strcmp(statList[index].name, event.name))
+                break;
+        if (index == statList.count())
+        {
+            ProfileStat stat = { event.name, 0, 0, 0, 0 };
+            statList += stat;
+        }
+        statForName.insert(event.name, index);
+    }
+
+    ProfileStat &stat = statList[index];
+    stat.lastMilliseconds = event.duration / 1.0e6;
+    stat.lastAllocations = event.allocations;
+    stat.peakAllocations = qMax(stat.peakAllocations, event.peakAllocations);
+    stat.calls++;
+}
+
+ProfileScope::ProfileScope(const char *name) : name(name)
+{
+    startAllocations = allocationCount;
+    startLiveAllocations = liveAllocations;
+
+    // track the peak of this scope separately, the outer peak is restored later
+    outerPeakAllocations = peakAllocations;
+    peakAllocations = startLiveAllocations;
+    startTime = now();
+}
+
+ProfileScope::~ProfileScope()
+{
+    ProfileEvent event;
+    event.duration = now() - startTime;
+    event.allocations = allocationCount - startAllocations;
+    event.peakAllocations = peakAllocations - startLiveAllocations;
+    peakAllocations = qMax(peakAllocations, outerPeakAllocations);
+
+    event.name = name;
+    event.start = startTime;
+    event.value = 0;
+    event.thread = (quintptr)QThread::currentThreadId();
+    record(event);
+}
+
+void Profiler::counter(const char *name, double value)
+{
+    ProfileEvent event;
+    event.name = name;
+    event.start = now();
+    event.duration = -1;
+    event.allocations = event.peakAllocations = 0;
+    event.value = value;
+    event.thread = (quintptr)QThread::currentThreadId();
+    record(event);
+}
+
+static bool statLessThan(const ProfileStat &a, const ProfileStat &b)
+{
+    return strcmp(a.name, b.name) < 0;
+}
+
+QList<ProfileStat> Profiler::stats()
+{
+    mutex.lock();
+    QList<ProfileStat> result = statList.toList();
+    mutex.unlock();
+    qSort(result.begin(), result.end(), statLessThan);
+    return result;
+}
+
+static void writeString(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\') fputc('\\', file);
+        fputc(*text, file);
+    }
+    fputc('"', file);
+}
+
+bool Profiler::writeTrace(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+
+    QMutexLocker locker(&mutex);
+
+    // thread handles are pointers, number them in order of appearance instead
+    QHash<quintptr, int> threadIndex;
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (int i = 0; i < events.count(); i++)
+    {
+        const ProfileEvent &event = events[i];
+        if (!threadIndex.contains(event.thread))
+            threadIndex.insert(event.thread, threadIndex.count());
+
+        fprintf(file, "{\"name\":");
+        writeString(file, event.name);
+        if (event.duration < 0)
+            fprintf(file, ",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%.17g}}",
+                event.start / 1.0e3, threadIndex[event.thread], event.value);
+        else
+            fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"allocations\":%d,\"peak allocations\":%d}}",
+                event.start / 1.0e3, event.duration / 1.0e3, threadIndex[event.thread],
+                event.allocations, event.peakAllocations);
+        fprintf(file, i + 1 < events.count() ? ",\n" : "\n");
+    }
+    fprintf(file, "],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\"dropped events\":%d}}\n", droppedEvents);
+
+    return fclose(file) == 0;
+}
+
+void Profiler::clear()
+{
+    QMutexLocker locker(&mutex);
+    events.clear();
+    droppedEvents = 0;
+    statList.clear();
+    statForName.clear();
+}
+
+#endif // ENABLE_PROFILER
@@ -0,0 +1,92 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/**
+ * Scoped timers and counters for finding out where time goes. Everything
+ * compiles away unless ENABLE_PROFILER is defined (see core.pri), so the
+ * macros can be left in hot code:
+ *
+ *     void CatmullMesh::subdivide(...)
+ *     {
+ *         PROFILE_SCOPE("CatmullMesh::subdivide");
+ *         ...
+ *         PROFILE_COUNTER("vertices", out.vertices.count());
+ *     }
+ *
+ * Each scope records its wall time, the number of heap allocations made
+ * while it was open and the peak number of those allocations that were
+ * alive at once. Allocations are counted per thread, so a scope only sees
+ * the ones made on its own thread and not those made by other threads at
+ * the same time, including work it hands to the thread pool. The recorded
+ * events can be written out in the Chrome trace event format (load them
+ * at chrome://tracing) and the most recent result for each scope name is
+ * available for drawing in the viewport.
+ */
+
+#ifdef ENABLE_PROFILER
+
+#include <QList>
+#include <string>
+
+#define PROFILE_CONCAT_HELPER(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_HELPER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::counter(name, value)
+
+class ProfileScope
+{
+private:
+    const char *name;
+    long long startTime;
+    int startAllocations;
+    int startLiveAllocations;
+    int outerPeakAllocations;
+
+public:
+    // name must be a string literal (it is stored, not copied)
+    ProfileScope(const char *name);
+    ~ProfileScope();
+};
+
+struct ProfileStat
+{
+    const char *name;
+    double lastMilliseconds;
+    int lastAllocations;
+    int peakAllocations; // largest peak seen across all runs of this scope
+    int calls;
+};
+
+class Profiler
+{
+public:
+    /**
+     * Record the value of a named counter at the current time.
+     */
+    static void counter(const char *name, double value);
+
+    /**
+     * The most recent timing of every scope name seen so far, sorted by name.
+     */
+    static QList<ProfileStat> stats();
+
+    /**
+     * Write every recorded event as Chrome trace event JSON. Returns false
+     * if the file couldn't be written.
+     */
+    static bool writeTrace(const std::string &file);
+
+    /**
+     * Forget all recorded events and stats.
+     */
+    static void clear();
+};
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNTER(name, value)
+
+#endif // ENABLE_PROFILER
+
+#endif // PROFILER_H
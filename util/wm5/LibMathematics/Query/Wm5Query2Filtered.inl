@@ -46,7 +46,7 @@ int Query2Filtered<Real>::ToLine (const Vector2<Real>& test, int v0, int v1)
     Real len1 = Math<Real>::Sqrt(x1*x1 + y1*y1);
     Real scaledUncertainty = mUncertainty*len0*len1;
 
-    Real det = Det2(x0, y0, x1, y1);
+    Real det = Query2<Real>::Det2(x0, y0, x1, y1);
     if (Math<Real>::FAbs(det) >= scaledUncertainty)
     {
         return (det > (Real)0 ? +1 : (det < (Real)0 ? -1 : 0));
@@ -84,7 +84,7 @@ int Query2Filtered<Real>::ToCircumcircle (const Vector2<Real>& test, int v0,
     Real len2 = Math<Real>::Sqrt(d2x*d2x + d2y*d2y + z2*z2);
     Real scaledUncertainty = mUncertainty*len0*len1*len2;
 
-    Real det = Det3(d0x, d0y, z0, d1x, d1y, z1, d2x, d2y, z2);
+    Real det = Query2<Real>::Det3(d0x, d0y, z0, d1x, d1y, z1, d2x, d2y, z2);
     if (Math<Real>::FAbs(det) >= scaledUncertainty)
     {
         return (det < (Real)0 ? 1 : (det > (Real)0 ? -1 : 0));
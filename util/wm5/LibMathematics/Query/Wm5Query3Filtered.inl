@@ -53,7 +53,7 @@ int Query3Filtered<Real>::ToPlane (const Vector3<Real>& test, int v0, int v1,
     Real len2 = Math<Real>::Sqrt(x2*x2 + y2*y2 + z2*z2);
     Real scaledUncertainty = mUncertainty*len0*len1*len2;
 
-    Real det = Det3(x0, y0, z0, x1, y1, z1, x2, y2, z2);
+    Real det = Query3<Real>::Det3(x0, y0, z0, x1, y1, z1, x2, y2, z2);
     if (Math<Real>::FAbs(det) >= scaledUncertainty)
     {
         return (det > (Real)0 ? +1 : (det < (Real)0 ? -1 : 0));
@@ -106,7 +106,7 @@ int Query3Filtered<Real>::ToCircumsphere (const Vector3<Real>& test, int v0,
     Real len3 = Math<Real>::Sqrt(d3x*d3x+d3y*d3y+d3z*d3z+w3*w3);
     Real scaledUncertainty = mUncertainty*len0*len1*len2*len3;
 
-    Real det = Det4(d0x, d0y, d0z, w0, d1x, d1y, d1z, w1, d2x, d2y, d2z,
+    Real det = Query3<Real>::Det4(d0x, d0y, d0z, w0, d1x, d1y, d1z, w1, d2x, d2y, d2z,
         w2, d3x, d3y, d3z, w3);
 
     if (Math<Real>::FAbs(det) >= scaledUncertainty)